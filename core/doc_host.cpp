@@ -0,0 +1,171 @@
+#include "doc_host.hpp"
+
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+
+// shard whose worker is the calling thread, if any
+static thread_local const void* tl_worker_shard = nullptr;
+
+// ---------- constructor / destructor ----------
+DocHost::DocHost(size_t num_workers, const std::string& oplog_dir)
+: oplog_dir_(oplog_dir) {
+    if (num_workers == 0) num_workers = std::thread::hardware_concurrency();
+    if (num_workers == 0) num_workers = 1;
+    if (!oplog_dir_.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(oplog_dir_, ec);
+        if (!std::filesystem::is_directory(oplog_dir_)) {
+            throw std::runtime_error("cannot create oplog dir " + oplog_dir_ + ": " + ec.message());
+        }
+    }
+    for (size_t i = 0; i < num_workers; ++i) {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+}
+
+DocHost::~DocHost() { stop(); }
+
+// ---------- start / stop ----------
+void DocHost::start() {
+    if (running_.exchange(true)) return;
+    for (auto& s : shards_) {
+        s->thread = std::thread(&DocHost::worker_fn, this, std::ref(*s));
+    }
+}
+
+void DocHost::stop() {
+    running_ = false;
+    for (auto& s : shards_) {
+        // take the lock so a worker between its check and wait can't miss this
+        { std::lock_guard<std::mutex> lk(s->mutex); }
+        s->cv.notify_all();
+    }
+    for (auto& s : shards_) {
+        if (s->thread.joinable()) s->thread.join();
+    }
+}
+
+// ---------- worker: drain own queue, exit once stopped and empty ----------
+void DocHost::worker_fn(Shard& s) {
+    tl_worker_shard = &s;
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lk(s.mutex);
+            s.cv.wait(lk, [&]{ return !s.tasks.empty() || !running_; });
+            if (s.tasks.empty()) break; // stopped and drained
+            task = std::move(s.tasks.front());
+            s.tasks.pop_front();
+        }
+        // tasks catch their own errors; this only keeps a stray one from
+        // terminating the process and with it every other shard
+        try {
+            task();
+        } catch (...) {
+            std::cerr << "[host] worker task threw, ignored\n";
+        }
+    }
+}
+
+// checked under the shard lock: stop() takes that lock after clearing running_,
+// so a task accepted here is always seen by the worker before it exits
+bool DocHost::post(uint32_t doc_id, std::function<void()> task) {
+    Shard& s = *shards_[shard_of(doc_id)];
+    {
+        std::lock_guard<std::mutex> lk(s.mutex);
+        if (!running_) return false;
+        s.tasks.push_back(std::move(task));
+    }
+    s.cv.notify_one();
+    return true;
+}
+
+// ---------- per-shard document lookup (worker thread only) ----------
+std::string DocHost::oplog_path(uint32_t doc_id) const {
+    return oplog_dir_ + "/doc-" + std::to_string(doc_id) + ".log";
+}
+
+Document& DocHost::doc_for(Shard& s, uint32_t doc_id) {
+    auto it = s.docs.find(doc_id);
+    if (it != s.docs.end()) return it->second;
+
+    // first touch: rebuild from its oplog if we keep one
+    Document doc;
+    if (!oplog_dir_.empty()) {
+        Document::drop_torn_tail(oplog_path(doc_id));
+        doc = Document::replay_from_log(oplog_path(doc_id));
+    }
+    return s.docs.emplace(doc_id, std::move(doc)).first->second;
+}
+
+// ---------- public API ----------
+bool DocHost::submit(uint32_t doc_id, const Op& op, ApplyCallback cb) {
+    Shard* s = shards_[shard_of(doc_id)].get();
+    return post(doc_id, [this, s, doc_id, op, cb]() {
+        // nothing may escape a worker task: that would terminate every document's host
+        Op applied;
+        Document* doc = nullptr;
+        std::string removed; // bytes the op overwrites, to undo it if it can't be logged
+        uint64_t prev_next_seq = 0;
+        try {
+            doc = &doc_for(*s, doc_id);
+            if (op.type != OpType::INSERT && op.pos <= doc->content.size()) {
+                removed = doc->content.substr(op.pos, op.len);
+            }
+            prev_next_seq = doc->next_seq;
+            applied = doc->apply(op);
+        } catch (const std::exception& e) {
+            std::cerr << "[host] doc " << doc_id << " rejected op seq=" << op.seq
+                      << ": " << e.what() << "\n";
+            return;
+        }
+        bool logged = true;
+        if (!oplog_dir_.empty()) {
+            try {
+                logged = Document::append_to_oplog(oplog_path(doc_id), applied);
+            } catch (const std::exception&) {
+                logged = false;
+            }
+        }
+        if (!logged) {
+            // unlogged ops must not be acked or survive in memory only
+            size_t inserted = applied.type == OpType::ERASE ? 0 : applied.text.size();
+            doc->content.replace(applied.pos, inserted, removed);
+            doc->next_seq = prev_next_seq;
+            std::cerr << "[host] doc " << doc_id << " seq=" << applied.seq
+                      << " not written to " << oplog_path(doc_id) << ", rolled back\n";
+            return;
+        }
+        if (!cb) return;
+        try {
+            cb(doc_id, applied);
+        } catch (const std::exception& e) {
+            std::cerr << "[host] doc " << doc_id << " callback for seq=" << applied.seq
+                      << " threw: " << e.what() << "\n";
+        } catch (...) {
+            std::cerr << "[host] doc " << doc_id << " callback for seq=" << applied.seq << " threw\n";
+        }
+    });
+}
+
+void DocHost::with_document(uint32_t doc_id, const std::function<void(Document&)>& fn) {
+    Shard* s = shards_[shard_of(doc_id)].get();
+    if (tl_worker_shard == s) {
+        // already on the owning worker: queueing and waiting would deadlock
+        fn(doc_for(*s, doc_id));
+        return;
+    }
+    std::promise<void> done;
+    bool queued = post(doc_id, [&]() {
+        try {
+            fn(doc_for(*s, doc_id));
+            done.set_value();
+        } catch (...) {
+            done.set_exception(std::current_exception());
+        }
+    });
+    if (!queued) throw std::runtime_error("DocHost not running");
+    done.get_future().get();
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+#include "document.hpp"
+
+// Hosts many documents in one process. Each document is owned by exactly one
+// worker (shard = doc_id % num_workers); apply, checksum and oplog append for a
+// document only ever run on its worker, so shards never share a lock.
+class DocHost {
+public:
+    // called on the owning worker after an op has been applied and logged.
+    // exceptions are caught and logged; the op stays applied
+    using ApplyCallback = std::function<void(uint32_t doc_id, const Op& applied)>;
+
+    // num_workers: size of the worker pool (0 -> hardware_concurrency)
+    // oplog_dir: if non-empty, each document is logged to <oplog_dir>/doc-<id>.log
+    //            and replayed from there the first time it is touched. created if
+    //            missing; throws std::runtime_error if that fails
+    DocHost(size_t num_workers, const std::string& oplog_dir);
+    ~DocHost();
+
+    // start/stop worker threads; stop drains already queued ops first
+    void start();
+    void stop();
+
+    // queue an op for doc_id (thread-safe). cb may be empty. returns false
+    // (op dropped) if the host is not running. an op that can't be appended to
+    // the oplog is rolled back and cb is not called
+    bool submit(uint32_t doc_id, const Op& op, ApplyCallback cb = nullptr);
+
+    // run fn on the document's worker and wait for it (thread-safe). called from
+    // that worker (e.g. inside an ApplyCallback) fn runs inline. throws
+    // std::runtime_error if the host is not running
+    void with_document(uint32_t doc_id, const std::function<void(Document&)>& fn);
+
+    size_t num_workers() const { return shards_.size(); }
+    size_t shard_of(uint32_t doc_id) const { return doc_id % shards_.size(); }
+
+private:
+    struct Shard {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<std::function<void()>> tasks;
+        // only touched from this shard's worker thread
+        std::unordered_map<uint32_t, Document> docs;
+    };
+
+    void worker_fn(Shard& s);
+    bool post(uint32_t doc_id, std::function<void()> task);
+    Document& doc_for(Shard& s, uint32_t doc_id);
+    std::string oplog_path(uint32_t doc_id) const;
+
+private:
+    std::string oplog_dir_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<bool> running_{false};
+};
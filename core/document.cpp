@@ -1,6 +1,7 @@
 #include "document.hpp"
 #include <sstream>
 #include <stdexcept>
+#include <filesystem>
 
 // --------- Apply operation ------------
 Op Document::apply(const Op& op_in) {
@@ -14,12 +15,12 @@ Op Document::apply(const Op& op_in) {
             break;
 
         case OpType::ERASE:
-            if (op.pos + op.len > content.size()) throw std::runtime_error("Erase OOB");
+            if (op.pos > content.size() || op.len > content.size() - op.pos) throw std::runtime_error("Erase OOB");
             content.erase(op.pos, op.len);
             break;
 
         case OpType::REPLACE:
-            if (op.pos + op.len > content.size()) throw std::runtime_error("Replace OOB");
+            if (op.pos > content.size() || op.len > content.size() - op.pos) throw std::runtime_error("Replace OOB");
             content.replace(op.pos, op.len, op.text);
             break;
     }
@@ -43,41 +44,119 @@ Op Document::make_replace(uint32_t pos, uint32_t len, const std::string& text) {
 }
 
 // --------- Oplog persistence ------------
-static std::string serialize(const Op& op) {
+// text is escaped ("\\" "\p" "\n" "\r") so a record is always one line of
+// exactly six '|'-separated fields, on the wire and in the oplog
+static std::string escape_text(const std::string& in) {
+    std::string out;
+    out.reserve(in.size());
+    for (char c : in) {
+        switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '|':  out += "\\p"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            default:   out += c;
+        }
+    }
+    return out;
+}
+static std::string unescape_text(const std::string& in) {
+    std::string out;
+    out.reserve(in.size());
+    for (size_t i = 0; i < in.size(); i++) {
+        if (in[i] != '\\') { out += in[i]; continue; }
+        if (++i == in.size()) throw std::runtime_error("Bad escape");
+        switch (in[i]) {
+            case '\\': out += '\\'; break;
+            case 'p':  out += '|'; break;
+            case 'n':  out += '\n'; break;
+            case 'r':  out += '\r'; break;
+            default: throw std::runtime_error("Bad escape");
+        }
+    }
+    return out;
+}
+
+std::string Document::encode_op(const Op& op) {
     std::ostringstream oss;
     oss << op.seq << "|" << int(op.type) << "|" 
         << op.pos << "|" << op.len << "|"
-        << op.text << "|" << op.doc_crc32 << "\n";
+        << escape_text(op.text) << "|" << op.doc_crc32 << "\n";
     return oss.str();
 }
-static Op deserialize(const std::string& line) {
-    std::stringstream ss(line);
-    Op op; int t;
-    std::string token;
-
-    std::getline(ss, token, '|'); op.seq = std::stoull(token);
-    std::getline(ss, token, '|'); t = std::stoi(token); op.type=(OpType)t;
-    std::getline(ss, token, '|'); op.pos = std::stoul(token);
-    std::getline(ss, token, '|'); op.len = std::stoul(token);
-    std::getline(ss, token, '|'); op.text = token;
-    std::getline(ss, token, '|'); op.doc_crc32 = std::stoul(token);
+Op Document::decode_op(const std::string& line_in) {
+    std::string line = line_in;
+    if (!line.empty() && line.back() == '\n') line.pop_back();
+
+    std::vector<std::string> f;
+    size_t start = 0;
+    while (true) {
+        size_t bar = line.find('|', start);
+        f.push_back(line.substr(start, bar - start));
+        if (bar == std::string::npos) break;
+        start = bar + 1;
+    }
+    if (f.size() != 6) throw std::runtime_error("Bad op record");
 
+    // stoul & co. accept trailing junk; a torn number must not slip through
+    auto num = [](const std::string& t, uint64_t max) -> uint64_t {
+        if (t.empty() || t.size() > 20 || t.find_first_not_of("0123456789") != std::string::npos)
+            throw std::runtime_error("Bad op field");
+        uint64_t v = std::stoull(t); // throws out_of_range past 2^64
+        if (v > max) throw std::runtime_error("Op field out of range");
+        return v;
+    };
+    Op op;
+    op.seq = num(f[0], UINT64_MAX);
+    uint64_t t = num(f[1], 3);
+    if (t < 1) throw std::runtime_error("Bad op type");
+    op.type = (OpType)t;
+    op.pos = (uint32_t)num(f[2], UINT32_MAX);
+    op.len = (uint32_t)num(f[3], UINT32_MAX);
+    op.text = unescape_text(f[4]);
+    op.doc_crc32 = (uint32_t)num(f[5], UINT32_MAX);
     return op;
 }
 
+// --------- Snapshots ------------
+std::string Document::encode_snapshot() const {
+    return std::to_string(get_seq()) + "|" + content;
+}
 
-void Document::append_to_oplog(const std::string& path, const Op& op) {
+Document Document::decode_snapshot(const std::string& payload) {
+    auto bar = payload.find('|');
+    if (bar == std::string::npos) throw std::runtime_error("Bad snapshot");
+    Document doc;
+    doc.next_seq = std::stoull(payload.substr(0, bar)) + 1;
+    doc.content = payload.substr(bar + 1); // content may itself contain '|'
+    return doc;
+}
+
+bool Document::append_to_oplog(const std::string& path, const Op& op) {
     std::ofstream f(path, std::ios::app);
-    f << serialize(op);
+    if (!f) return false;
+    f << encode_op(op);
+    f.flush();
+    return (bool)f;
 }
 
 std::vector<Op> Document::load_oplog(const std::string& path) {
     std::ifstream f(path);
     std::vector<Op> ops;
     std::string line;
+    size_t lineno = 0;
     while (std::getline(f, line)) {
-        if (!line.empty()) {
-            ops.push_back(deserialize(line));
+        ++lineno;
+        if (line.empty()) continue;
+        // every record ends in '\n'; an unterminated last line is a torn append
+        if (f.eof()) {
+            std::cerr << "[oplog] " << path << ":" << lineno << " torn record, ignored\n";
+            break;
+        }
+        try {
+            ops.push_back(decode_op(line));
+        } catch (const std::exception& e) {
+            std::cerr << "[oplog] " << path << ":" << lineno << " skipped: " << e.what() << "\n";
         }
     }
     return ops;
@@ -86,7 +165,37 @@ std::vector<Op> Document::load_oplog(const std::string& path) {
 Document Document::replay_from_log(const std::string& path) {
     Document doc;
     for (auto& op : load_oplog(path)) {
-        doc.apply(op);
+        try {
+            Op applied = doc.apply(op);
+            if (applied.doc_crc32 != op.doc_crc32) {
+                std::cerr << "[oplog] " << path << " seq=" << op.seq << " crc mismatch after replay\n";
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "[oplog] " << path << " seq=" << op.seq << " not replayed: " << e.what() << "\n";
+        }
     }
     return doc;
 }
+
+void Document::drop_torn_tail(const std::string& path) {
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(path, ec)) return;
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) return;
+    std::streamoff size = f.tellg();
+    if (size <= 0) return;
+
+    // scan back to the last '\n'; everything after it is the torn record
+    std::streamoff keep = size;
+    char c = 0;
+    while (keep > 0) {
+        f.seekg(keep - 1);
+        if (!f.get(c)) return;
+        if (c == '\n') break;
+        --keep;
+    }
+    f.close();
+    if (keep == size) return;
+    std::cerr << "[oplog] " << path << " dropping " << (size - keep) << " byte torn tail\n";
+    std::filesystem::resize_file(path, (uintmax_t)keep, ec);
+}
@@ -34,7 +34,20 @@ public:
     Op make_erase(uint32_t pos, uint32_t len);
     Op make_replace(uint32_t pos, uint32_t len, const std::string& text);
 
-    static void append_to_oplog(const std::string& path, const Op& op);
+    // one-line "seq|type|pos|len|text|crc" encoding shared by oplog and OP frames;
+    // text is escaped so it may hold '|' and newlines. decode_op throws on a bad record
+    static std::string encode_op(const Op& op);
+    static Op decode_op(const std::string& line);
+
+    // "seq|content" full-state encoding used to catch up a lagging replica
+    std::string encode_snapshot() const;
+    static Document decode_snapshot(const std::string& payload);
+
+    // false if the record could not be written (missing dir, disk full, ...)
+    static bool append_to_oplog(const std::string& path, const Op& op);
+    // bad or torn records are reported and skipped, never thrown
     static std::vector<Op> load_oplog(const std::string& path);
     static Document replay_from_log(const std::string& path);
+    // cut an unterminated last record (crash mid-append) so new appends start on a clean line
+    static void drop_torn_tail(const std::string& path);
 };
@@ -0,0 +1,401 @@
+#include "fanout.hpp"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+// ---------- utility helpers ----------
+static void set_nonblocking(int fd) {
+    int fl = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+}
+
+// ---------- constructor / destructor ----------
+Fanout::Fanout(int listen_port, size_t max_lag_bytes, LagPolicy policy)
+: listen_port_(listen_port), max_lag_bytes_(max_lag_bytes), policy_(policy) {}
+
+Fanout::~Fanout() { stop(); }
+
+void Fanout::set_catchup(CatchupFn fn) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    catchup_ = std::move(fn);
+}
+
+// ---------- start / stop ----------
+void Fanout::start() {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        perror("socket");
+        return;
+    }
+    int one = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(listen_port_);
+    if (bind(listen_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd_, SOMAXCONN) < 0) {
+        perror("fanout bind/listen");
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return;
+    }
+    set_nonblocking(listen_fd_);
+
+    // same-host readers (see Transport::connect_local); optional
+    local_listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un uaddr;
+    socklen_t ulen = local_socket_addr(listen_port_, uaddr);
+    if (local_listen_fd_ >= 0 &&
+        (bind(local_listen_fd_, (struct sockaddr*)&uaddr, ulen) < 0 || listen(local_listen_fd_, SOMAXCONN) < 0)) {
+        perror("fanout local bind/listen");
+        close(local_listen_fd_);
+        local_listen_fd_ = -1;
+    }
+    if (local_listen_fd_ >= 0) set_nonblocking(local_listen_fd_);
+
+    if (pipe(wake_fds_) < 0) {
+        perror("pipe");
+        return;
+    }
+    set_nonblocking(wake_fds_[0]);
+    set_nonblocking(wake_fds_[1]);
+
+    running_ = true;
+    io_thread_ = std::thread(&Fanout::io_thread_fn, this);
+}
+
+void Fanout::stop() {
+    if (!running_.exchange(false)) return;
+    char b = 1;
+    if (write(wake_fds_[1], &b, 1) < 0) { /* io thread also times out on poll */ }
+    if (io_thread_.joinable()) io_thread_.join();
+
+    std::lock_guard<std::mutex> lk(mutex_);
+    for (auto& p : peers_) close(p->fd);
+    peers_.clear();
+    close(listen_fd_);
+    if (local_listen_fd_ >= 0) close(local_listen_fd_);
+    close(wake_fds_[0]);
+    close(wake_fds_[1]);
+    listen_fd_ = local_listen_fd_ = wake_fds_[0] = wake_fds_[1] = -1;
+}
+
+void Fanout::wake() {
+    // one byte per io-thread wakeup, however many broadcasts land before it runs
+    if (wake_pending_.exchange(true)) return;
+    char b = 1;
+    if (write(wake_fds_[1], &b, 1) < 0) { /* pipe full: io thread is already awake */ }
+}
+
+// ---------- broadcast (writer thread) ----------
+FrameBuf Fanout::encode(const Frame& f) {
+    return std::make_shared<const std::string>(encode_frame(f));
+}
+
+void Fanout::broadcast(const Frame& f) {
+    broadcast(encode(f));
+}
+
+void Fanout::broadcast(const FrameBuf& buf) {
+    size_t n = buf->size();
+    bool queued = false;
+    std::vector<FrameBuf> snap; // built at most once per broadcast
+    bool have_snap = false;
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        for (auto& p : peers_) {
+            if (p->kick) continue;
+
+            if (!p->needs_catchup && p->queued_bytes + n <= max_lag_bytes_) {
+                p->pending.push_back(OutBuf{buf, true, false});
+                p->queued_bytes += n;
+                queued = true;
+                continue;
+            }
+
+            // new or too far behind: catch up, disconnect if it falls behind again mid catch-up
+            bool joining = p->needs_catchup;
+            p->needs_catchup = false;
+            if ((joining || policy_ == LagPolicy::CATCH_UP) && catchup_ && !p->catching_up) {
+                if (!have_snap) { snap = catchup_(); have_snap = true; }
+            }
+            if (!snap.empty() && !p->catching_up) {
+                for (auto& ob : p->pending) {
+                    if (ob.counted) p->queued_bytes -= ob.buf->size();
+                }
+                p->pending.clear();
+                p->drop_inflight = true;
+                for (size_t i = 0; i < snap.size(); ++i) {
+                    p->pending.push_back(OutBuf{snap[i], false, i + 1 == snap.size()});
+                }
+                p->catching_up = true;
+                if (joining) {
+                    std::cout << "[fanout] " << p->name << " joined, sending catch-up\n";
+                } else {
+                    ++catchups_;
+                    std::cout << "[fanout] " << p->name << " lagging, catching up\n";
+                }
+            } else if (joining) {
+                // nothing to catch up with: it just starts from this frame
+                p->pending.push_back(OutBuf{buf, true, false});
+                p->queued_bytes += n;
+            } else {
+                p->kick = true;
+                std::cout << "[fanout] " << p->name << " lagging, disconnecting\n";
+            }
+            queued = true;
+        }
+    }
+    if (queued) wake();
+}
+
+// ---------- io thread: accept, move queues, write, read ----------
+void Fanout::accept_peers(int lfd, bool local) {
+    while (true) {
+        sockaddr_in peer{};
+        socklen_t plen = sizeof(peer);
+        int fd = accept(lfd, local ? nullptr : (struct sockaddr*)&peer, local ? nullptr : &plen);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+            return;
+        }
+        auto p = std::make_shared<Peer>();
+        p->fd = fd;
+        if (local && !is_same_user_peer(fd)) {
+            close(fd);
+            continue;
+        }
+        if (local) {
+            // no ring here: answer the handshake with 'U' so the reader stays on the socket,
+            // before anything else is queued. a passed memfd is dropped with the hello byte
+            char reply = 'U';
+            if (send(fd, &reply, 1, MSG_NOSIGNAL) != 1) {
+                close(fd);
+                continue;
+            }
+            p->skip_hello = true;
+            p->name = "local#" + std::to_string(fd);
+        } else {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            char peerhost[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &peer.sin_addr, peerhost, sizeof(peerhost));
+            p->name = std::string(peerhost) + ":" + std::to_string(ntohs(peer.sin_port));
+        }
+        set_nonblocking(fd);
+        // keep the kernel's share of a peer's backlog near max_lag_bytes_, so lag
+        // builds up in our queue where the policy can see it
+        int sndbuf = (int)std::min<size_t>(max_lag_bytes_, 1 << 20);
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        std::cout << "[fanout] accepted connection from " << p->name << "\n";
+
+        std::lock_guard<std::mutex> lk(mutex_);
+        p->needs_catchup = (bool)catchup_;
+        peers_.push_back(std::move(p));
+    }
+}
+
+// called with mutex_ held
+void Fanout::take_pending(Peer& p) {
+    if (p.kick) {
+        p.dead = true;
+        return;
+    }
+    if (p.drop_inflight) {
+        // a partly written frame has to finish or the stream loses framing
+        size_t keep = p.cursor > 0 ? 1 : 0;
+        while (p.inflight.size() > keep) {
+            if (p.inflight.back().counted) p.queued_bytes -= p.inflight.back().buf->size();
+            p.inflight.pop_back();
+        }
+        p.drop_inflight = false;
+    }
+    for (auto& ob : p.pending) p.inflight.push_back(std::move(ob));
+    p.pending.clear();
+}
+
+void Fanout::flush_peer(Peer& p) {
+    while (!p.inflight.empty()) {
+        iovec iov[64];
+        int n = 0;
+        size_t off = p.cursor;
+        for (auto it = p.inflight.begin(); it != p.inflight.end() && n < 64; ++it) {
+            iov[n].iov_base = (void*)((*it).buf->data() + off);
+            iov[n].iov_len = (*it).buf->size() - off;
+            off = 0;
+            ++n;
+        }
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+        ssize_t w = sendmsg(p.fd, &msg, MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) p.dead = true;
+            return; // socket full: this peer waits, nobody else does
+        }
+
+        // advance the cursor over whatever the kernel took
+        size_t left = (size_t)w;
+        while (left > 0) {
+            OutBuf& front = p.inflight.front();
+            size_t rem = front.buf->size() - p.cursor;
+            if (left < rem) {
+                p.cursor += left;
+                break;
+            }
+            left -= rem;
+            if (front.counted) p.queued_bytes -= front.buf->size();
+            if (front.ends_catchup) {
+                std::lock_guard<std::mutex> lk(mutex_);
+                p.catching_up = false;
+            }
+            p.inflight.pop_front();
+            p.cursor = 0;
+        }
+    }
+}
+
+void Fanout::read_peer(Peer& p) {
+    char buf[4096];
+    while (true) {
+        ssize_t r = recv(p.fd, buf, sizeof(buf), 0);
+        if (r == 0) { p.dead = true; break; }
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) p.dead = true;
+            break;
+        }
+        p.inbuf.append(buf, (size_t)r);
+    }
+    if (p.skip_hello && !p.inbuf.empty()) {
+        p.inbuf.erase(0, 1);
+        p.skip_hello = false;
+    }
+
+    // same framing as Transport::io_thread_fn
+    size_t pos = 0;
+    while (p.inbuf.size() - pos >= 4) {
+        uint32_t len_be;
+        memcpy(&len_be, p.inbuf.data() + pos, 4);
+        uint32_t len = ntohl(len_be);
+        if (len < 5 || len > 10*1024*1024) {
+            std::cerr << "[fanout] invalid frame length from " << p.name << ": " << len << "\n";
+            p.dead = true;
+            break;
+        }
+        if (p.inbuf.size() - pos < 4 + (size_t)len) break;
+
+        Frame f;
+        f.type = (uint8_t)p.inbuf[pos + 4];
+        uint32_t doc_be;
+        memcpy(&doc_be, p.inbuf.data() + pos + 5, 4);
+        f.doc_id = ntohl(doc_be);
+        f.payload = p.inbuf.substr(pos + 9, len - 5);
+        {
+            std::lock_guard<std::mutex> lk(q_mutex_);
+            q_.push(std::move(f));
+        }
+        pos += 4 + len;
+    }
+    p.inbuf.erase(0, pos);
+}
+
+void Fanout::io_thread_fn() {
+    std::vector<pollfd> fds;
+    std::vector<std::shared_ptr<Peer>> peers; // io thread's view for this round
+
+    while (running_) {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            for (auto& p : peers_) take_pending(*p);
+            peers = peers_;
+        }
+        for (auto& p : peers) {
+            if (!p->dead) flush_peer(*p);
+        }
+
+        // reap peers that hung up, errored or were kicked for lagging
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            for (auto it = peers_.begin(); it != peers_.end();) {
+                if ((*it)->dead) {
+                    std::cout << "[fanout] " << (*it)->name << " disconnected\n";
+                    close((*it)->fd);
+                    ++disconnects_;
+                    it = peers_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            peers = peers_;
+        }
+
+        fds.clear();
+        fds.push_back(pollfd{wake_fds_[0], POLLIN, 0});
+        fds.push_back(pollfd{listen_fd_, POLLIN, 0});
+        fds.push_back(pollfd{local_listen_fd_, POLLIN, 0}); // ignored by poll when -1
+        for (auto& p : peers) {
+            short ev = POLLIN;
+            if (!p->inflight.empty()) ev |= POLLOUT;
+            fds.push_back(pollfd{p->fd, ev, 0});
+        }
+
+        int rc = poll(fds.data(), fds.size(), 200);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            // drain, then clear: a broadcast after the clear writes a fresh byte,
+            // and one that found the flag still set is picked up by the
+            // take_pending pass at the top of the next iteration
+            char b[256];
+            while (read(wake_fds_[0], b, sizeof(b)) > 0) {}
+            wake_pending_ = false;
+        }
+        if (fds[1].revents & POLLIN) accept_peers(listen_fd_, false);
+        if (fds[2].revents & POLLIN) accept_peers(local_listen_fd_, true);
+        for (size_t i = 0; i < peers.size(); ++i) {
+            if (fds[i + 3].revents & (POLLIN | POLLHUP | POLLERR)) read_peer(*peers[i]);
+        }
+    }
+}
+
+// ---------- inbound / stats ----------
+bool Fanout::pop_frame(Frame& out) {
+    std::lock_guard<std::mutex> lk(q_mutex_);
+    if (q_.empty()) return false;
+    out = std::move(q_.front());
+    q_.pop();
+    return true;
+}
+
+size_t Fanout::peer_count() const {
+    std::lock_guard<std::mutex> lk(mutex_);
+    return peers_.size();
+}
+
+size_t Fanout::queued_bytes() const {
+    std::lock_guard<std::mutex> lk(mutex_);
+    size_t total = 0;
+    for (auto& p : peers_) total += p->queued_bytes;
+    return total;
+}
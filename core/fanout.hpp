@@ -0,0 +1,120 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <queue>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+#include "transport.hpp"
+
+// encoded frame shared (read-only) by every peer queue it is broadcast to
+using FrameBuf = std::shared_ptr<const std::string>;
+
+// Writer-side one-to-many transport. broadcast() encodes a frame once and only
+// queues a pointer per peer; a single poll thread owns the sockets and drains
+// each peer from its own send cursor, so a slow reader never blocks the writer
+// or the other readers. Readers connect with a plain client Transport; same-host
+// readers are accepted on the AF_UNIX endpoint too (plain socket, no shm ring).
+class Fanout {
+public:
+    enum class LagPolicy {
+        CATCH_UP,   // drop the reader's backlog and queue frames from the catch-up hook
+        DISCONNECT, // drop the reader
+    };
+
+    // called from inside broadcast(), on the broadcasting thread, when a peer
+    // joins or first exceeds its lag limit. returns frames that bring a replica
+    // up to date including the frame being broadcast (e.g. a SNAPSHOT taken
+    // after applying the op). must not call back into this Fanout.
+    // it only ever runs inside broadcast(), so it may rely on whatever lock the
+    // writer holds around broadcast; the flip side is that a peer joining an
+    // idle document gets no state until the next broadcast. a writer that can
+    // sit idle should broadcast something cheap (e.g. a PING) now and then
+    using CatchupFn = std::function<std::vector<FrameBuf>()>;
+
+    // max_lag_bytes: queued-but-unsent bytes a peer may have before the policy kicks in
+    Fanout(int listen_port, size_t max_lag_bytes, LagPolicy policy);
+    ~Fanout();
+
+    // start/stop the accept + io thread
+    void start();
+    void stop();
+
+    // without a hook CATCH_UP falls back to DISCONNECT
+    void set_catchup(CatchupFn fn);
+
+    // encode once, queue for every connected peer (thread-safe, never blocks on a socket)
+    void broadcast(const Frame& f);
+    void broadcast(const FrameBuf& buf);
+    static FrameBuf encode(const Frame& f);
+
+    // pop a frame received from any peer (thread-safe)
+    bool pop_frame(Frame& out);
+
+    size_t peer_count() const;
+    size_t queued_bytes() const; // broadcast bytes not yet written, summed over peers
+    uint64_t catchups() const { return catchups_.load(); }
+    uint64_t disconnects() const { return disconnects_.load(); }
+
+private:
+    struct OutBuf {
+        FrameBuf buf;
+        bool counted;      // counts toward the lag limit (catch-up frames don't)
+        bool ends_catchup; // last frame of a catch-up batch
+    };
+
+    struct Peer {
+        int fd = -1;
+        std::string name;
+
+        // guarded by mutex_
+        std::deque<OutBuf> pending;
+        bool drop_inflight = false; // io thread should discard its unsent backlog
+        bool catching_up = false;
+        bool needs_catchup = false; // joined mid-stream, gets the catch-up frames first
+        bool kick = false;          // io thread should disconnect this peer
+        std::atomic<size_t> queued_bytes{0};
+
+        // io thread only
+        std::deque<OutBuf> inflight;
+        size_t cursor = 0;          // bytes of inflight.front() already sent
+        std::string inbuf;
+        bool skip_hello = false;    // AF_UNIX peer: first inbound byte is the local handshake
+        bool dead = false;
+    };
+
+    void io_thread_fn();
+    void accept_peers(int lfd, bool local);
+    void take_pending(Peer& p);
+    void flush_peer(Peer& p);
+    void read_peer(Peer& p);
+    void wake();
+
+private:
+    int listen_port_;
+    size_t max_lag_bytes_;
+    LagPolicy policy_;
+    CatchupFn catchup_;
+
+    std::thread io_thread_;
+    int listen_fd_ = -1;
+    int local_listen_fd_ = -1;
+    int wake_fds_[2] = {-1, -1}; // self-pipe: broadcast -> io thread
+    std::atomic<bool> wake_pending_{false};
+
+    mutable std::mutex mutex_; // peers_ and each peer's pending side
+    std::vector<std::shared_ptr<Peer>> peers_;
+
+    // incoming queue
+    mutable std::mutex q_mutex_;
+    std::queue<Frame> q_;
+
+    std::atomic<bool> running_{false};
+    std::atomic<uint64_t> catchups_{0};
+    std::atomic<uint64_t> disconnects_{0};
+};
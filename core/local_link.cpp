@@ -0,0 +1,288 @@
+#include "local_link.hpp"
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <ifaddrs.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <new>
+
+// ---------- local addressing ----------
+socklen_t local_socket_addr(int port, sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::string name = "syncpad-" + std::to_string(port);
+    // sun_path[0] stays '\0': abstract namespace
+    memcpy(addr.sun_path + 1, name.data(), name.size());
+    return (socklen_t)(offsetof(sockaddr_un, sun_path) + 1 + name.size());
+}
+
+bool is_local_host(const std::string& host) {
+    addrinfo hints{}, *res = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &res) != 0 || !res) return false;
+    in_addr target = ((sockaddr_in*)res->ai_addr)->sin_addr;
+    freeaddrinfo(res);
+
+    if ((ntohl(target.s_addr) >> 24) == 127) return true; // 127.0.0.0/8
+
+    ifaddrs* ifs = nullptr;
+    if (getifaddrs(&ifs) != 0) return false;
+    bool local = false;
+    for (ifaddrs* i = ifs; i && !local; i = i->ifa_next) {
+        if (!i->ifa_addr || i->ifa_addr->sa_family != AF_INET) continue;
+        local = ((sockaddr_in*)i->ifa_addr)->sin_addr.s_addr == target.s_addr;
+    }
+    freeifaddrs(ifs);
+    return local;
+}
+
+bool is_same_user_peer(int fd) {
+    ucred cred{};
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) return false;
+    if (cred.uid == getuid()) return true;
+    std::cerr << "[local] rejecting peer pid " << cred.pid << " uid " << cred.uid << "\n";
+    return false;
+}
+
+// ---------- shared layout ----------
+// positions are running byte counts; head - tail is the fill level
+struct ShmLink::Ring {
+    alignas(64) std::atomic<uint64_t> head{0};       // producer side
+    std::atomic<uint32_t> data_seq{0};               // futex word: bumped after produce
+    std::atomic<uint32_t> consumer_waiting{0};
+    alignas(64) std::atomic<uint64_t> tail{0};       // consumer side
+    std::atomic<uint32_t> space_seq{0};              // futex word: bumped after consume
+    std::atomic<uint32_t> producer_waiting{0};
+};
+
+struct ShmLink::Header {
+    uint32_t magic;
+    uint32_t ring_bytes;
+    std::atomic<uint32_t> closed{0};
+    Ring rings[2]; // [0] creator -> attacher, [1] attacher -> creator
+};
+
+static const uint32_t kShmMagic = 0x53504431; // "SPD1"
+static const int kShmSeals = F_SEAL_SHRINK | F_SEAL_GROW;
+static const int kSpinIters = 200;
+static const int kWaitSliceMs = 100; // futex sleeps in slices to notice a dead peer
+
+size_t ShmLink::header_bytes() {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (sizeof(ShmLink::Header) + page - 1) / page * page;
+}
+
+// futex words live in a MAP_SHARED mapping, so no FUTEX_PRIVATE_FLAG
+static void futex_wait(std::atomic<uint32_t>* addr, uint32_t expected, int timeout_ms) {
+    timespec ts{timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000};
+    syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t>* addr) {
+    syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+// spin, then announce ourselves and sleep on seq until ready() or the link dies
+template <typename Ready, typename Alive>
+static bool wait_on(std::atomic<uint32_t>& seq, std::atomic<uint32_t>& waiting,
+                    const std::atomic<uint32_t>& closed, Ready ready, Alive alive) {
+    for (int i = 0; i < kSpinIters; ++i) {
+        if (ready()) return true;
+        cpu_relax();
+    }
+    while (true) {
+        waiting.store(1);
+        uint32_t s = seq.load();
+        // re-check after announcing, so a producer/consumer that missed the flag can't strand us
+        if (ready()) { waiting.store(0); return true; }
+        if (closed.load() || !alive()) { waiting.store(0); return false; }
+        futex_wait(&seq, s, kWaitSliceMs);
+        waiting.store(0);
+        if (ready()) return true;
+    }
+}
+
+// ---------- create / attach ----------
+std::unique_ptr<ShmLink> ShmLink::create(size_t ring_bytes, int sock_fd, int& fd_out) {
+    // power of two so positions wrap with a mask
+    size_t cap = 4096;
+    while (cap < ring_bytes) cap <<= 1;
+
+    int fd = (int)syscall(SYS_memfd_create, "syncpad-link", MFD_ALLOW_SEALING | MFD_CLOEXEC);
+    if (fd < 0) return nullptr;
+    size_t len = header_bytes() + 2 * cap;
+    // sealed size: neither side can shrink the mapping under the other (SIGBUS)
+    if (ftruncate(fd, (off_t)len) < 0 || fcntl(fd, F_ADD_SEALS, kShmSeals) < 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    void* map = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) { ::close(fd); return nullptr; }
+
+    Header* hdr = new (map) Header();
+    hdr->magic = kShmMagic;
+    hdr->ring_bytes = (uint32_t)cap;
+
+    std::unique_ptr<ShmLink> link(new ShmLink());
+    link->map_ = map;
+    link->map_len_ = len;
+    link->sock_fd_ = sock_fd;
+    link->hdr_ = hdr;
+    link->cap_ = cap;
+    char* data = (char*)map + header_bytes();
+    link->tx_ = &hdr->rings[0]; link->tx_data_ = data;
+    link->rx_ = &hdr->rings[1]; link->rx_data_ = data + cap;
+    fd_out = fd;
+    return link;
+}
+
+std::unique_ptr<ShmLink> ShmLink::attach(int memfd, int sock_fd) {
+    // unsealed, the creator could truncate it after we checked the size
+    int seals = fcntl(memfd, F_GET_SEALS);
+    if (seals < 0 || (seals & kShmSeals) != kShmSeals) return nullptr;
+    struct stat st{};
+    if (fstat(memfd, &st) < 0 || (size_t)st.st_size < header_bytes()) return nullptr;
+    size_t len = (size_t)st.st_size;
+    void* map = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (map == MAP_FAILED) return nullptr;
+
+    Header* hdr = (Header*)map;
+    size_t cap = hdr->ring_bytes;
+    bool pow2 = cap >= 4096 && (cap & (cap - 1)) == 0; // positions are masked with cap - 1
+    if (hdr->magic != kShmMagic || !pow2 || header_bytes() + 2 * cap != len) {
+        munmap(map, len);
+        return nullptr;
+    }
+
+    std::unique_ptr<ShmLink> link(new ShmLink());
+    link->map_ = map;
+    link->map_len_ = len;
+    link->sock_fd_ = sock_fd;
+    link->hdr_ = hdr;
+    link->cap_ = cap;
+    char* data = (char*)map + header_bytes();
+    link->tx_ = &hdr->rings[1]; link->tx_data_ = data + cap;
+    link->rx_ = &hdr->rings[0]; link->rx_data_ = data;
+    return link;
+}
+
+ShmLink::~ShmLink() {
+    close();
+    if (map_) munmap(map_, map_len_);
+}
+
+void ShmLink::close() {
+    if (!hdr_) return;
+    hdr_->closed.store(1);
+    for (Ring& r : hdr_->rings) {
+        r.data_seq.fetch_add(1);
+        r.space_seq.fetch_add(1);
+        futex_wake(&r.data_seq);
+        futex_wake(&r.space_seq);
+    }
+}
+
+// the unix socket carries nothing after the handshake: readable means EOF
+bool ShmLink::peer_alive() const {
+    if (sock_fd_ < 0) return true;
+    pollfd p{sock_fd_, POLLIN, 0};
+    if (poll(&p, 1, 0) <= 0) return true;
+    if (p.revents & (POLLHUP | POLLERR)) return false;
+    char b;
+    return recv(sock_fd_, &b, 1, MSG_PEEK | MSG_DONTWAIT) != 0;
+}
+
+// ---------- byte pipe ----------
+bool ShmLink::write_all(const void* buf, size_t len) {
+    const char* p = (const char*)buf;
+    Ring& r = *tx_;
+    auto alive = [this]{ return peer_alive(); };
+    while (len > 0) {
+        if (hdr_->closed.load()) return false;
+        uint64_t head = r.head.load(std::memory_order_relaxed); // only we write head
+        uint64_t tail = r.tail.load(std::memory_order_acquire);
+        // the peer owns tail: behind head by more than cap_, or ahead of it, is corruption
+        if (head - tail > cap_) {
+            close();
+            return false;
+        }
+        size_t room = cap_ - (size_t)(head - tail);
+        if (room == 0) {
+            auto has_room = [&]{ return r.tail.load(std::memory_order_acquire) != tail; };
+            if (!wait_on(r.space_seq, r.producer_waiting, hdr_->closed, has_room, alive)) return false;
+            continue;
+        }
+
+        size_t n = std::min(len, room);
+        size_t off = (size_t)head & (cap_ - 1);
+        size_t first = std::min(n, cap_ - off);
+        memcpy(tx_data_ + off, p, first);
+        memcpy(tx_data_, p + first, n - first);
+        r.head.store(head + n); // seq_cst: ordered before the waiting check below
+        if (r.consumer_waiting.load()) {
+            r.data_seq.fetch_add(1);
+            futex_wake(&r.data_seq);
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool ShmLink::read_all(void* buf, size_t len) {
+    char* p = (char*)buf;
+    Ring& r = *rx_;
+    auto alive = [this]{ return peer_alive(); };
+    while (len > 0) {
+        uint64_t tail = r.tail.load(std::memory_order_relaxed); // only we write tail
+        uint64_t head = r.head.load(std::memory_order_acquire);
+        if (head - tail > cap_) { // peer-written head out of range (tail > head wraps huge)
+            close();
+            return false;
+        }
+        size_t avail = (size_t)(head - tail);
+        if (avail == 0) {
+            auto has_data = [&]{ return r.head.load(std::memory_order_acquire) != tail; };
+            if (!wait_on(r.data_seq, r.consumer_waiting, hdr_->closed, has_data, alive)) return false;
+            continue;
+        }
+
+        size_t n = std::min(len, avail);
+        size_t off = (size_t)tail & (cap_ - 1);
+        size_t first = std::min(n, cap_ - off);
+        memcpy(p, rx_data_ + off, first);
+        memcpy(p + first, rx_data_, n - first);
+        r.tail.store(tail + n); // seq_cst: ordered before the waiting check below
+        if (r.producer_waiting.load()) {
+            r.space_seq.fetch_add(1);
+            futex_wake(&r.space_seq);
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Same-host fast path helpers (linux): AF_UNIX addressing for a syncpad port,
+// local-peer detection, and a shared-memory byte pipe between two processes.
+
+// abstract-namespace AF_UNIX address "\0syncpad-<port>" (no file to clean up)
+socklen_t local_socket_addr(int port, sockaddr_un& addr);
+
+// true if host resolves to loopback or to one of this machine's addresses
+bool is_local_host(const std::string& host);
+
+// true if the process on the other end of a connected AF_UNIX socket runs as
+// our uid (SO_PEERCRED). the abstract socket name is reachable by any user
+bool is_same_user_peer(int fd);
+
+// Two single-producer/single-consumer byte rings in one memfd mapping, one per
+// direction. Bytes are the normal wire framing, so readers parse frames exactly
+// as they would from a socket. Empty/full waits spin briefly, then sleep on a
+// futex in the shared mapping. The AF_UNIX socket the memfd was passed over is
+// kept only to notice the other process dying.
+class ShmLink {
+public:
+    // creator side: makes the mapping; fd_out is the memfd to pass to the peer
+    static std::unique_ptr<ShmLink> create(size_t ring_bytes, int sock_fd, int& fd_out);
+    // other side: maps a memfd received from the creator
+    static std::unique_ptr<ShmLink> attach(int memfd, int sock_fd);
+    ~ShmLink();
+
+    // block until all bytes are written/read. false once the link is closed
+    // (reads still drain what the peer wrote before closing). ring positions
+    // written by the peer are untrusted: an impossible fill level closes the link
+    bool write_all(const void* buf, size_t len);
+    bool read_all(void* buf, size_t len);
+
+    // mark closed for both processes and wake any waiter
+    void close();
+
+private:
+    struct Ring;
+    struct Header;
+
+    ShmLink() = default;
+    static size_t header_bytes();
+    bool peer_alive() const;
+
+private:
+    void* map_ = nullptr;
+    size_t map_len_ = 0;
+    int sock_fd_ = -1; // not owned
+    Header* hdr_ = nullptr;
+    Ring* tx_ = nullptr;
+    Ring* rx_ = nullptr;
+    char* tx_data_ = nullptr;
+    char* rx_data_ = nullptr;
+    size_t cap_ = 0;
+};
@@ -6,6 +6,11 @@
 #include <netdb.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <poll.h>
 
 #include <cstring>
 #include <iostream>
@@ -18,6 +23,34 @@ static void set_reuseaddr(int fd) {
     setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
 }
 
+// frames are small and latency-sensitive; don't let Nagle hold them back
+static void set_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// bound a blocking recv (0 = no timeout again)
+static void set_recv_timeout(int fd, int ms) {
+    timeval tv{ms / 1000, (ms % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+static const size_t kShmRingBytes = 1 << 20;
+
+// ---------- framing ----------
+std::string encode_frame(const Frame& f) {
+    uint32_t len = 5 + (uint32_t)f.payload.size();
+    uint32_t len_be = htonl(len);
+    uint32_t doc_be = htonl(f.doc_id);
+    std::string buf;
+    buf.reserve(4 + len);
+    buf.append((const char*)&len_be, sizeof(len_be));
+    buf.push_back((char)f.type);
+    buf.append((const char*)&doc_be, sizeof(doc_be));
+    buf.append(f.payload);
+    return buf;
+}
+
 // ---------- constructor / destructor ----------
 Transport::Transport(int listen_port, const std::string& peer_host, int peer_port)
 : listen_port_(listen_port), peer_host_(peer_host), peer_port_(peer_port) {}
@@ -42,28 +75,24 @@ void Transport::start() {
 void Transport::stop() {
     running_ = false;
 
-    // close listening socket to unblock accept
-    if (listen_fd_ >= 0) {
-        close(listen_fd_);
-        listen_fd_ = -1;
-    }
-
-    // close connection socket
-    {
+    // shut the connection down so the io thread's read returns; it closes its own fd
+    auto close_conn = [this]() {
         std::lock_guard<std::mutex> lk(conn_mutex_);
-        if (conn_fd_ >= 0) {
-            close(conn_fd_);
-            conn_fd_ = -1;
-        }
-    }
+        if (conn_fd_ >= 0) shutdown(conn_fd_, SHUT_RDWR);
+        if (shm_) shm_->close(); // wakes an io thread waiting on the ring
+    };
+    close_conn();
+
+    // wake an io thread blocked on a full queue, and any waiting pop
+    { std::lock_guard<std::mutex> lk(q_mutex_); }
+    q_cv_.notify_all();
+    q_space_cv_.notify_all();
 
-    // join threads
+    // join threads; the accept thread polls with a timeout and closes its own listeners
     if (accept_thread_.joinable()) accept_thread_.join();
     if (connect_thread_.joinable()) connect_thread_.join();
+    close_conn(); // anything accepted/connected while they were winding down
     if (io_thread_.joinable()) io_thread_.join();
-
-    // notify any waiting pop
-    q_cv_.notify_all();
 }
 
 // ---------- accept thread (server) ----------
@@ -92,30 +121,167 @@ void Transport::accept_thread_fn() {
         return;
     }
 
+    // same-host peers come in on "\0syncpad-<port>"; without it they just use TCP
+    if (local_mode_ != LocalMode::TCP) {
+        local_listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un uaddr;
+        socklen_t ulen = local_socket_addr(listen_port_, uaddr);
+        if (local_listen_fd_ >= 0 &&
+            (bind(local_listen_fd_, (struct sockaddr*)&uaddr, ulen) < 0 || listen(local_listen_fd_, 1) < 0)) {
+            perror("local bind/listen");
+            close(local_listen_fd_);
+            local_listen_fd_ = -1;
+        }
+    }
+
     while (running_) {
-        sockaddr_in peer{};
-        socklen_t plen = sizeof(peer);
-        int fd = accept(listen_fd_, (struct sockaddr*)&peer, &plen);
-        if (fd < 0) {
-            if (!running_) break;
-            perror("accept");
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            continue;
+        pollfd fds[2] = {{listen_fd_, POLLIN, 0}, {local_listen_fd_, POLLIN, 0}};
+        int rc = poll(fds, local_listen_fd_ >= 0 ? 2 : 1, 200);
+        if (rc <= 0) continue; // timeout (re-check running_) or EINTR
+
+        if (fds[0].revents & POLLIN) {
+            sockaddr_in peer{};
+            socklen_t plen = sizeof(peer);
+            int fd = accept(listen_fd_, (struct sockaddr*)&peer, &plen);
+            if (fd < 0) {
+                perror("accept");
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+
+            char peerhost[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &peer.sin_addr, peerhost, sizeof(peerhost));
+            if (connected_) {
+                // one peer per Transport (many readers go through a Fanout); the
+                // live link wins, so two reconnecting clients can't keep evicting each other
+                std::cout << "[transport] busy, refusing " << peerhost << ":" << ntohs(peer.sin_port) << "\n";
+                close(fd);
+                continue;
+            }
+            std::cout << "[transport] accepted connection from " << peerhost << ":" << ntohs(peer.sin_port) << "\n";
+
+            // set non-blocking? we keep blocking for simplicity in io thread
+            set_connected_fd(fd, nullptr, "tcp");
         }
 
-        char peerhost[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &peer.sin_addr, peerhost, sizeof(peerhost));
-        std::cout << "[transport] accepted connection from " << peerhost << ":" << ntohs(peer.sin_port) << "\n";
+        if (local_listen_fd_ >= 0 && (fds[1].revents & POLLIN)) {
+            int fd = accept(local_listen_fd_, nullptr, nullptr);
+            if (fd < 0) {
+                perror("accept");
+                continue;
+            }
+            if (connected_) {
+                std::cout << "[transport] busy, refusing local connection\n";
+                close(fd);
+                continue;
+            }
+            std::shared_ptr<ShmLink> shm;
+            if (!accept_local(fd, shm)) {
+                close(fd);
+                continue;
+            }
+            std::cout << "[transport] accepted local connection (" << (shm ? "shm" : "unix") << ")\n";
+            set_connected_fd(fd, shm, shm ? "shm" : "unix");
+        }
+    }
+
+    close(listen_fd_);
+    listen_fd_ = -1;
+    if (local_listen_fd_ >= 0) {
+        close(local_listen_fd_);
+        local_listen_fd_ = -1;
+    }
+}
+
+// ---------- same-host handshake ----------
+// client -> server: 'S' + memfd (SCM_RIGHTS) to offer a ring, or 'U' for plain AF_UNIX
+// server -> client: 'S' if it mapped the ring, else 'U'. frames follow on the agreed path
+int Transport::connect_local(std::shared_ptr<ShmLink>& shm) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_un addr;
+    socklen_t alen = local_socket_addr(peer_port_, addr);
+    if (connect(fd, (struct sockaddr*)&addr, alen) < 0) {
+        close(fd);
+        return -1;
+    }
+    // anyone can bind an abstract name first; don't hand our ring to another user
+    if (!is_same_user_peer(fd)) {
+        close(fd);
+        return -1;
+    }
+
+    int memfd = -1;
+    std::unique_ptr<ShmLink> link;
+    if (local_mode_ == LocalMode::SHM) link = ShmLink::create(kShmRingBytes, fd, memfd);
+
+    char hello = link ? 'S' : 'U';
+    iovec iov{&hello, 1};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    alignas(cmsghdr) char ctrl[CMSG_SPACE(sizeof(int))];
+    if (link) {
+        msg.msg_control = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+        cmsghdr* c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(c), &memfd, sizeof(int));
+    }
+    ssize_t w = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (memfd >= 0) close(memfd); // the mapping stays; the peer has its own copy of the fd
+
+    char reply = 0;
+    set_recv_timeout(fd, 1000);
+    if (w != 1 || !read_all(fd, &reply, 1) || (reply != 'S' && reply != 'U')) {
+        close(fd);
+        return -1;
+    }
+    set_recv_timeout(fd, 0);
+
+    // server may decline the ring, e.g. a Fanout or a peer running with LocalMode::UNIX
+    if (reply == 'S' && link) shm = std::move(link);
+    return fd;
+}
 
-        // set non-blocking? we keep blocking for simplicity in io thread
-        set_connected_fd(fd);
+bool Transport::accept_local(int fd, std::shared_ptr<ShmLink>& shm) {
+    if (!is_same_user_peer(fd)) return false;
+
+    char hello = 0;
+    iovec iov{&hello, 1};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    alignas(cmsghdr) char ctrl[CMSG_SPACE(sizeof(int))];
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+
+    set_recv_timeout(fd, 1000);
+    ssize_t r = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    set_recv_timeout(fd, 0);
+    if (r != 1) return false;
+
+    int memfd = -1;
+    cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    if (c && c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+        memcpy(&memfd, CMSG_DATA(c), sizeof(int));
+    }
+    if (hello == 'S' && memfd >= 0 && local_mode_ == LocalMode::SHM) {
+        shm = ShmLink::attach(memfd, fd);
     }
+    if (memfd >= 0) close(memfd);
+
+    char reply = shm ? 'S' : 'U';
+    return write_all(fd, &reply, 1);
 }
 
 // ---------- connect thread (client, with exponential backoff capped ~3s) ----------
 void Transport::connect_thread_fn() {
     double delay = 0.1; // start 100ms
     const double max_delay = 3.0;
+    auto up_since = std::chrono::steady_clock::time_point();
 
     while (running_) {
         // if already connected, sleep and continue
@@ -123,6 +289,31 @@ void Transport::connect_thread_fn() {
             std::this_thread::sleep_for(std::chrono::milliseconds(200));
             continue;
         }
+        // a link that dropped right after connecting (e.g. a busy server closing
+        // it) counts as a failed attempt, so we back off instead of spinning
+        if (up_since != std::chrono::steady_clock::time_point()) {
+            bool brief = std::chrono::steady_clock::now() - up_since < std::chrono::seconds(1);
+            up_since = std::chrono::steady_clock::time_point();
+            if (brief) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(delay));
+                delay = std::min(delay * 2, max_delay);
+                continue;
+            }
+            delay = 0.1;
+        }
+
+        // same host: AF_UNIX (+ shared-memory ring) instead of loopback TCP
+        if (local_mode_ != LocalMode::TCP && is_local_host(peer_host_)) {
+            std::shared_ptr<ShmLink> shm;
+            int fd = connect_local(shm);
+            if (fd >= 0) {
+                const char* kind = shm ? "shm" : "unix";
+                std::cout << "[connect] connected to " << peer_host_ << ":" << peer_port_ << " via " << kind << "\n";
+                up_since = std::chrono::steady_clock::now();
+                set_connected_fd(fd, shm, kind);
+                continue;
+            }
+        }
 
         // resolve host
         addrinfo hints{}, *res = nullptr;
@@ -161,38 +352,61 @@ void Transport::connect_thread_fn() {
 
         // success
         std::cout << "[connect] connected to " << peer_host_ << ":" << peer_port_ << "\n";
-        delay = 0.1;
-        set_connected_fd(fd);
+        up_since = std::chrono::steady_clock::now();
+        set_connected_fd(fd, nullptr, "tcp");
     }
 }
 
 // ---------- set/clear connection ----------
-void Transport::set_connected_fd(int fd) {
+// each io thread owns the fd/ring it was started with and closes them itself;
+// conn_gen_ tells it whether it is still the current link when it exits
+void Transport::set_connected_fd(int fd, std::shared_ptr<ShmLink> shm, const char* kind) {
     {
+        // retire the previous link (if any) and let its io thread wind down
         std::lock_guard<std::mutex> lk(conn_mutex_);
-        if (conn_fd_ >= 0) {
-            close(conn_fd_);
-            conn_fd_ = -1;
-        }
+        if (conn_fd_ >= 0) shutdown(conn_fd_, SHUT_RDWR);
+        if (shm_) shm_->close();
+        conn_fd_ = -1;
+        shm_.reset();
+        link_kind_ = "";
+        connected_ = false;
+        ++conn_gen_;
+    }
+    { std::lock_guard<std::mutex> lk(q_mutex_); }
+    q_space_cv_.notify_all(); // in case it is parked on a full queue
+    if (io_thread_.joinable()) io_thread_.join();
+
+    uint64_t gen;
+    {
+        std::lock_guard<std::mutex> lk(conn_mutex_);
+        if (!shm && std::string(kind) == "tcp") set_nodelay(fd);
         conn_fd_ = fd;
+        shm_ = shm;
+        link_kind_ = kind;
         connected_ = true;
+        gen = ++conn_gen_;
     }
 
-    // start io thread to read frames from this fd
-    if (io_thread_.joinable()) {
-        // if previous io_thread exists, join it (should usually be joined when cleared)
-        io_thread_.join();
-    }
-    io_thread_ = std::thread(&Transport::io_thread_fn, this, fd);
+    // start io thread to read frames from this fd (or its ring)
+    io_thread_ = std::thread(&Transport::io_thread_fn, this, fd, shm, gen);
 }
 
-void Transport::clear_connected_fd() {
-    std::lock_guard<std::mutex> lk(conn_mutex_);
-    if (conn_fd_ >= 0) {
-        close(conn_fd_);
-        conn_fd_ = -1;
+void Transport::clear_connected_fd(int fd, std::shared_ptr<ShmLink> shm, uint64_t gen) {
+    {
+        // only touch shared state if no newer link has replaced ours
+        std::lock_guard<std::mutex> lk(conn_mutex_);
+        if (conn_gen_ == gen) {
+            conn_fd_ = -1;
+            shm_.reset();
+            link_kind_ = "";
+            connected_ = false;
+            ++conn_gen_;
+        }
     }
-    connected_ = false;
+    if (shm) shm->close();
+    // under write_mutex_ so a send_frame that still holds our fd finishes first
+    std::lock_guard<std::mutex> wlk(write_mutex_);
+    close(fd);
 }
 
 // ---------- low-level io helpers ----------
@@ -200,7 +414,7 @@ bool Transport::write_all(int fd, const void* buf, size_t len) {
     const char* p = (const char*)buf;
     size_t remaining = len;
     while (remaining > 0) {
-        ssize_t w = ::send(fd, p, remaining, 0);
+        ssize_t w = ::send(fd, p, remaining, MSG_NOSIGNAL); // peer gone -> error, not SIGPIPE
         if (w <= 0) {
             if (errno == EINTR) continue;
             return false;
@@ -228,65 +442,106 @@ bool Transport::read_all(int fd, void* buf, size_t len) {
 }
 
 // ---------- IO thread: read frames, push to queue ----------
-void Transport::io_thread_fn(int fd) {
+void Transport::io_thread_fn(int fd, std::shared_ptr<ShmLink> shm, uint64_t gen) {
+    // same framing either way; only the byte source differs
+    auto read_all = [&](void* buf, size_t len) {
+        return shm ? shm->read_all(buf, len) : this->read_all(fd, buf, len);
+    };
+
     while (running_) {
         // read 4-byte length (big-endian)
         uint32_t len_be = 0;
-        if (!read_all(fd, &len_be, sizeof(len_be))) break;
+        if (!read_all(&len_be, sizeof(len_be))) break;
         uint32_t len = ntohl(len_be);
-        if (len == 0 || len > 10*1024*1024) { // sanity limit 10MB
+        if (len < 5 || len > 10*1024*1024) { // type + doc_id, sanity limit 10MB
             std::cerr << "[io] invalid frame length: " << len << "\n";
             break;
         }
 
-        // read 1-byte type
+        // read 1-byte type, 4-byte doc_id (big-endian)
         uint8_t type = 0;
-        if (!read_all(fd, &type, 1)) break;
-        size_t payload_len = len - 1;
+        if (!read_all(&type, 1)) break;
+        uint32_t doc_be = 0;
+        if (!read_all(&doc_be, sizeof(doc_be))) break;
+        size_t payload_len = len - 5;
         std::string payload;
         if (payload_len > 0) {
             payload.resize(payload_len);
-            if (!read_all(fd, payload.data(), payload_len)) break;
+            if (!read_all(payload.data(), payload_len)) break;
         }
 
-        // push frame to queue
+        // push frame to queue, waiting for room if the consumer is behind
         {
-            std::lock_guard<std::mutex> lk(q_mutex_);
-            q_.push(Frame{type, payload});
+            std::unique_lock<std::mutex> lk(q_mutex_);
+            size_t cost = payload.size() + kFrameOverhead;
+            q_space_cv_.wait(lk, [&]{
+                return q_.empty() || q_bytes_ + cost <= kMaxQueuedBytes || !running_ || conn_gen_ != gen;
+            });
+            if (!running_ || conn_gen_ != gen) break;
+            q_bytes_ += cost;
+            q_.push(Frame{type, std::move(payload), ntohl(doc_be)});
         }
         q_cv_.notify_one();
     }
 
     // connection closed or error: clear connection
     std::cout << "[io] connection closed or error\n";
-    clear_connected_fd();
+    clear_connected_fd(fd, shm, gen);
 }
 
 // ---------- public send_frame (thread-safe) ----------
 bool Transport::send_frame(const Frame& f) {
-    std::lock_guard<std::mutex> lk(conn_mutex_);
+    // whole frame goes out in a single send / ring write
+    std::string buf = encode_frame(f);
+
+    std::unique_lock<std::mutex> lk(conn_mutex_);
     if (conn_fd_ < 0) return false;
+    if (shm_) {
+        // the shared_ptr keeps the mapping alive, so a full ring doesn't hold conn_mutex_
+        std::shared_ptr<ShmLink> shm = shm_;
+        lk.unlock();
+        std::lock_guard<std::mutex> wlk(write_mutex_); // single producer on the ring
+        return shm->write_all(buf.data(), buf.size());
+    }
     int fd = conn_fd_;
+    uint64_t gen = conn_gen_;
+    lk.unlock();
 
+    // the io thread closes fd under write_mutex_ after retiring gen
     std::lock_guard<std::mutex> wlk(write_mutex_);
-    uint32_t len = 1 + (uint32_t)f.payload.size();
-    uint32_t len_be = htonl(len);
-    if (!write_all(fd, &len_be, sizeof(len_be))) return false;
-    if (!write_all(fd, &f.type, 1)) return false;
-    if (len > 1) {
-        if (!write_all(fd, f.payload.data(), f.payload.size())) return false;
-    }
-    return true;
+    if (conn_gen_ != gen) return false;
+    return write_all(fd, buf.data(), buf.size());
 }
 
 bool Transport::pop_frame(Frame &out) {
     std::unique_lock<std::mutex> lk(q_mutex_);
     if (q_.empty()) return false;
-    out = q_.front();
+    out = std::move(q_.front());
     q_.pop();
+    q_bytes_ -= out.payload.size() + kFrameOverhead;
+    lk.unlock();
+    q_space_cv_.notify_one();
+    return true;
+}
+
+bool Transport::wait_frame(Frame &out, int timeout_ms) {
+    std::unique_lock<std::mutex> lk(q_mutex_);
+    q_cv_.wait_for(lk, std::chrono::milliseconds(timeout_ms),
+                   [&]{ return !q_.empty() || !running_; });
+    if (q_.empty()) return false;
+    out = std::move(q_.front());
+    q_.pop();
+    q_bytes_ -= out.payload.size() + kFrameOverhead;
+    lk.unlock();
+    q_space_cv_.notify_one();
     return true;
 }
 
 bool Transport::is_connected() const {
     return connected_.load();
 }
+
+std::string Transport::link_kind() const {
+    std::lock_guard<std::mutex> lk(conn_mutex_);
+    return link_kind_;
+}
@@ -6,20 +6,38 @@
 #include <queue>
 #include <atomic>
 #include <optional>
+#include <memory>
 #include <cstdint>
 
+#include "local_link.hpp"
+
 struct Frame {
-    uint8_t type;        // 1=HELLO,2=ACK,3=PING,4=PONG
+    uint8_t type;        // 1=HELLO,2=ACK,3=PING,4=PONG,5=OP,6=SNAPSHOT
     std::string payload; // raw payload (UTF-8)
+    uint32_t doc_id = 0; // document this frame belongs to (0 = default document)
 };
 
+// wire encoding of one frame: [len:4 BE][type:1][doc_id:4 BE][payload], len covers type..payload
+std::string encode_frame(const Frame& f);
+
 class Transport {
 public:
-    // listen_port: if >0 the transport will listen and accept incoming connections (server mode)
+    // how to reach a peer on the same host (TCP is always the fallback)
+    enum class LocalMode {
+        SHM,  // AF_UNIX socket, then frames over a shared-memory ring (default)
+        UNIX, // AF_UNIX socket only
+        TCP,  // always TCP, even over loopback
+    };
+
+    // listen_port: if >0 the transport will listen and accept incoming connections (server mode).
+    //             it serves one peer at a time and refuses others while that link is up
     // peer_host/peer_port: if non-empty, transport will attempt to connect (client mode)
     Transport(int listen_port, const std::string& peer_host, int peer_port);
     ~Transport();
 
+    // pick the same-host fast path; call before start()
+    void set_local_mode(LocalMode m) { local_mode_ = m; }
+
     // start background threads (accept/connect/io)
     void start();
 
@@ -32,40 +50,62 @@ public:
     // pop a received frame (thread-safe). returns true if frame was popped into out.
     bool pop_frame(Frame &out);
 
+    // like pop_frame but waits up to timeout_ms for a frame to arrive
+    bool wait_frame(Frame &out, int timeout_ms);
+
     // query connected state
     bool is_connected() const;
 
+    // "tcp", "unix" or "shm" for the current connection, "" when disconnected
+    std::string link_kind() const;
+
 private:
     // internal helpers
     void accept_thread_fn();
     void connect_thread_fn();
-    void io_thread_fn(int fd);
+    void io_thread_fn(int fd, std::shared_ptr<ShmLink> shm, uint64_t gen);
+
+    // same-host handshake over AF_UNIX; both return the ring when one was agreed
+    int connect_local(std::shared_ptr<ShmLink>& shm);
+    bool accept_local(int fd, std::shared_ptr<ShmLink>& shm);
 
     // low-level read/write
     bool write_all(int fd, const void* buf, size_t len);
     bool read_all(int fd, void* buf, size_t len);
 
     // create/close connection
-    void set_connected_fd(int fd);
-    void clear_connected_fd();
+    void set_connected_fd(int fd, std::shared_ptr<ShmLink> shm, const char* kind);
+    void clear_connected_fd(int fd, std::shared_ptr<ShmLink> shm, uint64_t gen);
 
 private:
     int listen_port_;
     std::string peer_host_;
     int peer_port_;
+    LocalMode local_mode_ = LocalMode::SHM;
 
     std::thread accept_thread_;
     std::thread connect_thread_;
     std::thread io_thread_;
 
     int listen_fd_ = -1;
+    int local_listen_fd_ = -1;
     mutable std::mutex conn_mutex_;
     int conn_fd_ = -1;
-
-    // incoming queue
+    std::shared_ptr<ShmLink> shm_; // set when frames go through shared memory
+    const char* link_kind_ = "";
+    std::atomic<uint64_t> conn_gen_{0}; // bumped whenever the current link is replaced or cleared
+
+    // incoming queue, bounded by bytes and kept small so a slow consumer pushes
+    // back through the socket/ring and its lag shows up on the sender (e.g. in
+    // a Fanout's per-peer queue) instead of hiding here. a frame larger than
+    // the bound is still taken when the queue is empty
+    static constexpr size_t kMaxQueuedBytes = 16 * 1024;
+    static constexpr size_t kFrameOverhead = 64; // so floods of tiny frames count too
     mutable std::mutex q_mutex_;
     std::condition_variable q_cv_;
+    std::condition_variable q_space_cv_;
     std::queue<Frame> q_;
+    size_t q_bytes_ = 0;
 
     std::atomic<bool> running_{false};
     std::atomic<bool> connected_{false};
@@ -0,0 +1,507 @@
+#include "../core/transport.hpp"
+#include "../core/fanout.hpp"
+#include "../core/document.hpp"
+#include "../tests/test_util.hpp" // wait_until
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+#include <sys/resource.h>
+
+// Local load generator: one writer broadcasts ops through a Fanout to N
+// readers on loopback Transport connections, readers apply them and check
+// doc_crc32. A reader that lags past --max-lag is caught up with a SNAPSHOT
+// frame ("seq|content") or dropped, per --lag-policy.
+//
+// OP frame payload used here: "<send_ns>|<Document::encode_op(op)>", where
+// send_ns is steady_clock (CLOCK_MONOTONIC) so it is comparable across
+// processes on the same host.
+
+struct LoadOptions {
+    std::string role = "all";     // all | writer | reader
+    int readers = 4;
+    int writers = 1;              // editing threads feeding the one writer document
+    int port = 6000;              // writer's fanout port
+    std::string peer_host = "127.0.0.1";
+    std::string trace = "typing"; // typing | paste | replace | massreplace | mixed
+    std::string trace_file;       // recorded oplog to replay instead of a synthetic trace
+    uint64_t ops = 10000;
+    double rate = 1000;           // total ops/s across writers, 0 = as fast as possible
+    size_t max_doc = 1 << 20;     // synthetic traces erase once the doc grows past this
+    uint32_t doc_id = 0;
+    uint32_t seed = 42;
+    int idle_ms = 3000;           // reader gives up after this long without frames
+    size_t max_lag = 4 << 20;     // per-reader unsent bytes before the lag policy applies
+    std::string lag_policy = "catchup"; // catchup | disconnect
+    int slow_readers = 0;         // first n readers sleep slow_us per op
+    int slow_us = 1000;
+    Transport::LocalMode local = Transport::LocalMode::SHM; // readers' same-host link
+};
+
+void print_help(const char* prog) {
+    std::cout << "Usage:\n"
+              << prog << " [--role all|writer|reader] [options]\n"
+              << "options:\n"
+              << "  --readers <n>        simulated readers (default 4)\n"
+              << "  --writers <n>        editing threads on the writer (default 1)\n"
+              << "  --port <port>        writer port (default 6000)\n"
+              << "  --peer <host>        writer host for --role reader (default 127.0.0.1)\n"
+              << "  --trace <kind>       typing|paste|replace|massreplace|mixed\n"
+              << "                       (default typing)\n"
+              << "  --trace-file <path>  replay a recorded oplog\n"
+              << "  --ops <n>            ops to send (default 10000)\n"
+              << "  --rate <ops/s>       total send rate, 0 = unthrottled (default 1000)\n"
+              << "  --max-doc <bytes>    cap synthetic doc size (default 1048576)\n"
+              << "  --doc <id>           doc_id to tag frames with (default 0)\n"
+              << "  --seed <n>           rng seed (default 42)\n"
+              << "  --max-lag <bytes>    per-reader backlog limit (default 4194304)\n"
+              << "  --lag-policy <p>     catchup|disconnect (default catchup)\n"
+              << "  --slow-readers <n>   make the first n readers slow\n"
+              << "  --slow-us <us>       per-op delay of a slow reader (default 1000)\n"
+              << "  --local <mode>       readers' same-host link: shm|unix|tcp (default shm;\n"
+              << "                       the fanout answers shm offers with a plain unix socket)\n";
+}
+
+static int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double cpu_seconds() {
+    rusage ru{};
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6
+         + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+// ---------- synthetic edit traces ----------
+class TraceGen {
+public:
+    TraceGen(const std::string& kind, uint32_t seed, size_t max_doc)
+    : kind_(kind), rng_(seed), max_doc_(max_doc) {}
+
+    // next op, valid against the current state of doc
+    Op next(const Document& doc) {
+        size_t size = doc.get().size();
+        if (size > max_doc_) return erase_chunk(size);
+
+        std::string k = kind_;
+        if (k == "mixed") {
+            int r = pick(0, 99);
+            k = r < 80 ? "typing" : r < 90 ? "paste" : r < 99 ? "replace" : "massreplace";
+        }
+        if (k == "paste") return paste(size);
+        if (k == "replace") return replace(size);
+        if (k == "massreplace") return mass_replace(doc.get());
+        return type_char(size);
+    }
+
+private:
+    int pick(int lo, int hi) { return std::uniform_int_distribution<int>(lo, hi)(rng_); }
+
+    // prose-like text; the odd '|' and newline exercise encode_op's escaping
+    std::string text(size_t n) {
+        static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz     \n|";
+        std::string s(n, ' ');
+        for (auto& c : s) c = alphabet[pick(0, sizeof(alphabet) - 2)];
+        return s;
+    }
+
+    Op type_char(size_t size) {
+        if (cursor_ > size) cursor_ = size;
+        Op op;
+        if (cursor_ > 0 && pick(0, 9) == 0) { // backspace
+            op.type = OpType::ERASE; op.pos = --cursor_; op.len = 1;
+        } else {
+            op.type = OpType::INSERT; op.pos = cursor_++; op.text = text(1);
+        }
+        return op;
+    }
+
+    Op paste(size_t size) {
+        Op op; op.type = OpType::INSERT;
+        op.pos = pick(0, (int)size);
+        op.text = text(pick(256, 4096));
+        cursor_ = op.pos + op.text.size();
+        return op;
+    }
+
+    Op replace(size_t size) {
+        if (size == 0) return paste(size);
+        Op op; op.type = OpType::REPLACE;
+        op.pos = pick(0, (int)size - 1);
+        op.len = pick(1, (int)std::min<size_t>(64, size - op.pos));
+        op.text = text(pick(1, 64));
+        return op;
+    }
+
+    // "replace all": every match of a short token in the doc, as one REPLACE
+    // spanning first..last match, so the op is roughly document-sized
+    Op mass_replace(const std::string& content) {
+        // grow the doc first so there is something worth replacing
+        if (content.size() < std::max<size_t>(64, max_doc_ / 4)) return paste(content.size());
+
+        std::string token;
+        for (int tries = 0; tries < 8 && token.empty(); ++tries) {
+            size_t at = pick(0, (int)content.size() - 2);
+            std::string t = content.substr(at, 2);
+            if (t.find_first_of(" \n|") == std::string::npos) token = t;
+        }
+        std::string with = text(pick(1, 4));
+
+        size_t first = token.empty() ? std::string::npos : content.find(token);
+        if (first == std::string::npos) {
+            // no usable token: rewrite half to all of the doc instead
+            Op op; op.type = OpType::REPLACE;
+            op.len = pick((int)content.size() / 2, (int)content.size());
+            op.pos = pick(0, (int)(content.size() - op.len));
+            op.text = text(op.len);
+            return op;
+        }
+
+        std::string out;
+        size_t end = first, at = first;
+        while (at != std::string::npos) {
+            out.append(content, end, at - end);
+            out += with;
+            end = at + token.size();
+            at = content.find(token, end);
+        }
+        Op op; op.type = OpType::REPLACE;
+        op.pos = (uint32_t)first;
+        op.len = (uint32_t)(end - first);
+        op.text = std::move(out);
+        return op;
+    }
+
+    Op erase_chunk(size_t size) {
+        Op op; op.type = OpType::ERASE;
+        op.len = std::min<size_t>(size, max_doc_ / 4 + 1);
+        op.pos = pick(0, (int)(size - op.len));
+        cursor_ = op.pos;
+        return op;
+    }
+
+private:
+    std::string kind_;
+    std::mt19937 rng_;
+    size_t max_doc_;
+    size_t cursor_ = 0;
+};
+
+// ---------- writer side ----------
+struct WriterState {
+    std::mutex mu;   // guards doc; broadcast happens under it so seq order is preserved
+    Document doc;
+    std::unique_ptr<Fanout> fanout;
+    std::vector<Op> trace;   // recorded ops when replaying a file
+    size_t trace_pos = 0;
+    uint64_t sent = 0;
+    uint64_t rejected = 0;
+    uint64_t last_seq = 0;   // seq of the last op broadcast; a rejected op still burns one
+};
+
+static void writer_thread_fn(WriterState& w, const LoadOptions& opt, int idx, uint64_t quota) {
+    TraceGen gen(opt.trace, opt.seed + idx, opt.max_doc);
+    double per_thread_rate = opt.rate / opt.writers;
+    auto interval = per_thread_rate > 0
+        ? std::chrono::nanoseconds((int64_t)(1e9 / per_thread_rate))
+        : std::chrono::nanoseconds(0);
+    auto deadline = std::chrono::steady_clock::now();
+
+    for (uint64_t i = 0; i < quota; ++i) {
+        if (interval.count() > 0) {
+            deadline += interval;
+            std::this_thread::sleep_until(deadline);
+        }
+
+        std::lock_guard<std::mutex> lk(w.mu);
+        Op op;
+        if (!w.trace.empty()) {
+            op = w.trace[w.trace_pos++];
+            op.seq = 0; // let the writer doc number them
+        } else {
+            op = gen.next(w.doc);
+        }
+
+        int64_t ts = now_ns();
+        Op applied;
+        try {
+            applied = w.doc.apply(op);
+        } catch (const std::exception&) {
+            ++w.rejected;
+            continue;
+        }
+
+        Frame f;
+        f.type = 5; // OP
+        f.doc_id = opt.doc_id;
+        f.payload = std::to_string(ts) + "|" + Document::encode_op(applied);
+        w.fanout->broadcast(f);
+        w.last_seq = applied.seq;
+        ++w.sent;
+    }
+}
+
+// ---------- reader side ----------
+struct ReaderStats {
+    std::vector<int64_t> lat_ns;
+    uint64_t applied = 0;
+    uint64_t crc_mismatch = 0;
+    uint64_t errors = 0;
+    uint64_t snapshots = 0;
+    uint64_t last_seq = 0;
+    uint32_t final_crc = 0;
+    uint32_t last_op_crc = 0;
+};
+
+// expect is the seq to stop at; an in-process writer sets it to the last seq it
+// actually broadcast once it is done, until then it reads as "never"
+static void reader_thread_fn(Transport& t, const LoadOptions& opt, int idx,
+                             const std::atomic<uint64_t>& expect, ReaderStats& st) {
+    Document doc;
+    st.lat_ns.reserve(opt.ops);
+    auto last_frame = std::chrono::steady_clock::now();
+    bool started = false;
+    bool slow = idx < opt.slow_readers;
+
+    // snapshots may skip ops on the way to the last seq
+    while (doc.get_seq() < expect.load()) {
+        Frame f;
+        if (!t.wait_frame(f, 100)) {
+            // before the first op allow for connect/backoff, afterwards idle_ms
+            auto idle = std::chrono::steady_clock::now() - last_frame;
+            auto limit = std::chrono::milliseconds(started ? opt.idle_ms : 30000);
+            if (idle > limit) break;
+            continue;
+        }
+        last_frame = std::chrono::steady_clock::now();
+        if (slow) std::this_thread::sleep_for(std::chrono::microseconds(opt.slow_us));
+        if (f.type == 6) { // SNAPSHOT: replace state wholesale
+            try {
+                doc = Document::decode_snapshot(f.payload);
+                st.last_op_crc = crc32(doc.get());
+                ++st.snapshots;
+                started = true;
+            } catch (const std::exception&) {
+                ++st.errors;
+            }
+            continue;
+        }
+        if (f.type != 5) continue;
+        started = true;
+
+        auto bar = f.payload.find('|');
+        if (bar == std::string::npos) { ++st.errors; continue; }
+        try {
+            int64_t ts = std::stoll(f.payload.substr(0, bar));
+            Op op = Document::decode_op(f.payload.substr(bar + 1));
+            Op applied = doc.apply(op);
+            st.lat_ns.push_back(now_ns() - ts);
+            if (applied.doc_crc32 != op.doc_crc32) ++st.crc_mismatch;
+            st.last_op_crc = op.doc_crc32;
+            ++st.applied;
+        } catch (const std::exception&) {
+            ++st.errors;
+        }
+    }
+    st.last_seq = doc.get_seq();
+    st.final_crc = crc32(doc.get());
+}
+
+// ---------- reporting ----------
+static void print_latency(std::vector<int64_t>& ns) {
+    if (ns.empty()) {
+        std::cout << "[latency] no samples\n";
+        return;
+    }
+    std::sort(ns.begin(), ns.end());
+    auto pct = [&](double p) {
+        size_t i = std::min(ns.size() - 1, (size_t)(p / 100.0 * ns.size()));
+        return ns[i] / 1000.0;
+    };
+    std::cout << std::fixed << std::setprecision(1)
+              << "[latency] samples=" << ns.size() << " (us)"
+              << " p50=" << pct(50) << " p90=" << pct(90) << " p99=" << pct(99)
+              << " p99.9=" << pct(99.9) << " max=" << ns.back() / 1000.0 << "\n";
+}
+
+int main(int argc, char** argv) {
+    LoadOptions opt;
+
+    // simple arg parse
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--role" && i+1 < argc) opt.role = argv[++i];
+        else if (a == "--readers" && i+1 < argc) opt.readers = std::stoi(argv[++i]);
+        else if (a == "--writers" && i+1 < argc) opt.writers = std::stoi(argv[++i]);
+        else if (a == "--port" && i+1 < argc) opt.port = std::stoi(argv[++i]);
+        else if (a == "--peer" && i+1 < argc) opt.peer_host = argv[++i];
+        else if (a == "--trace" && i+1 < argc) opt.trace = argv[++i];
+        else if (a == "--trace-file" && i+1 < argc) opt.trace_file = argv[++i];
+        else if (a == "--ops" && i+1 < argc) opt.ops = std::stoull(argv[++i]);
+        else if (a == "--rate" && i+1 < argc) opt.rate = std::stod(argv[++i]);
+        else if (a == "--max-doc" && i+1 < argc) opt.max_doc = std::stoul(argv[++i]);
+        else if (a == "--doc" && i+1 < argc) opt.doc_id = std::stoul(argv[++i]);
+        else if (a == "--seed" && i+1 < argc) opt.seed = std::stoul(argv[++i]);
+        else if (a == "--max-lag" && i+1 < argc) opt.max_lag = std::stoul(argv[++i]);
+        else if (a == "--lag-policy" && i+1 < argc) opt.lag_policy = argv[++i];
+        else if (a == "--slow-readers" && i+1 < argc) opt.slow_readers = std::stoi(argv[++i]);
+        else if (a == "--slow-us" && i+1 < argc) opt.slow_us = std::stoi(argv[++i]);
+        else if (a == "--local" && i+1 < argc) {
+            std::string m = argv[++i];
+            if (m == "shm") opt.local = Transport::LocalMode::SHM;
+            else if (m == "unix") opt.local = Transport::LocalMode::UNIX;
+            else if (m == "tcp") opt.local = Transport::LocalMode::TCP;
+            else { std::cerr << "local must be shm|unix|tcp\n"; return 1; }
+        }
+        else if (a == "--help" || a == "-h") { print_help(argv[0]); return 0; }
+        else { std::cerr << "unknown option: " << a << "\n"; print_help(argv[0]); return 1; }
+    }
+    if (opt.role != "all" && opt.role != "writer" && opt.role != "reader") {
+        print_help(argv[0]); return 1;
+    }
+    if (opt.lag_policy != "catchup" && opt.lag_policy != "disconnect") {
+        print_help(argv[0]); return 1;
+    }
+    if (opt.readers < 1 || opt.writers < 1) {
+        std::cerr << "need at least one reader and one writer\n"; return 1;
+    }
+
+    bool run_writer = opt.role != "reader";
+    bool run_readers = opt.role != "writer";
+
+    WriterState w;
+    if (run_writer && !opt.trace_file.empty()) {
+        w.trace = Document::load_oplog(opt.trace_file);
+        if (w.trace.empty()) { std::cerr << "empty trace: " << opt.trace_file << "\n"; return 1; }
+        opt.ops = std::min<uint64_t>(opt.ops, w.trace.size());
+        opt.writers = 1; // a recorded trace is a single ordered stream
+    }
+
+    // writer serves every reader from one fanout port
+    if (run_writer) {
+        auto policy = opt.lag_policy == "catchup" ? Fanout::LagPolicy::CATCH_UP
+                                                  : Fanout::LagPolicy::DISCONNECT;
+        w.fanout = std::make_unique<Fanout>(opt.port, opt.max_lag, policy);
+        // runs inside broadcast() with w.mu already held by the writer thread
+        w.fanout->set_catchup([&w, &opt]() {
+            Frame f;
+            f.type = 6; // SNAPSHOT
+            f.doc_id = opt.doc_id;
+            f.payload = w.doc.encode_snapshot();
+            return std::vector<FrameBuf>{Fanout::encode(f)};
+        });
+        w.fanout->start();
+    }
+    std::vector<std::unique_ptr<Transport>> reader_links;
+    if (run_readers) {
+        for (int i = 0; i < opt.readers; ++i) {
+            reader_links.push_back(std::make_unique<Transport>(0, opt.peer_host, opt.port));
+            reader_links.back()->set_local_mode(opt.local);
+        }
+    }
+    for (auto& t : reader_links) t->start();
+
+    if (opt.role == "all" && !wait_until([&]{
+            return std::all_of(reader_links.begin(), reader_links.end(),
+                               [](const std::unique_ptr<Transport>& t){ return t->is_connected(); });
+        }, 10000)) {
+        std::cerr << "[loadgen] readers failed to connect\n"; return 1;
+    }
+    if (run_writer && !wait_until([&]{ return w.fanout->peer_count() >= (size_t)opt.readers; },
+                                  opt.role == "all" ? 10000 : 60000)) {
+        std::cerr << "[loadgen] readers failed to connect\n"; return 1;
+    }
+
+    std::cout << "[loadgen] role=" << opt.role << " readers=" << opt.readers
+              << " writers=" << opt.writers << " trace="
+              << (opt.trace_file.empty() ? opt.trace : opt.trace_file)
+              << " ops=" << opt.ops << " rate=" << opt.rate;
+    if (!reader_links.empty()) std::cout << " link=" << reader_links[0]->link_kind();
+    std::cout << "\n";
+
+    double cpu0 = cpu_seconds();
+    auto t0 = std::chrono::steady_clock::now();
+
+    // a standalone reader can only assume every op was accepted
+    std::atomic<uint64_t> expect_seq{run_writer ? std::numeric_limits<uint64_t>::max() : opt.ops};
+    std::vector<ReaderStats> stats(run_readers ? opt.readers : 0);
+    std::vector<std::thread> readers, writers;
+    for (size_t i = 0; i < stats.size(); ++i) {
+        readers.emplace_back(reader_thread_fn, std::ref(*reader_links[i]), std::cref(opt),
+                             (int)i, std::cref(expect_seq), std::ref(stats[i]));
+    }
+    if (run_writer) {
+        for (int i = 0; i < opt.writers; ++i) {
+            uint64_t quota = opt.ops / opt.writers + (i < (int)(opt.ops % opt.writers) ? 1 : 0);
+            writers.emplace_back(writer_thread_fn, std::ref(w), std::cref(opt), i, quota);
+        }
+    }
+    for (auto& th : writers) th.join();
+    auto t_sent = std::chrono::steady_clock::now();
+    if (run_writer) expect_seq = w.last_seq;
+    for (auto& th : readers) th.join();
+    auto t1 = std::chrono::steady_clock::now();
+    double cpu = cpu_seconds() - cpu0;
+
+    // ---------- report ----------
+    bool ok = true;
+    std::cout << std::fixed << std::setprecision(1);
+    if (run_writer) {
+        double secs = std::chrono::duration<double>(t_sent - t0).count();
+        std::cout << "[writer] sent=" << w.sent << " rejected=" << w.rejected
+                  << " in " << secs << "s -> " << (secs > 0 ? w.sent / secs : 0) << " ops/s"
+                  << " doc_bytes=" << w.doc.get().size()
+                  << " catchups=" << w.fanout->catchups()
+                  << " disconnects=" << w.fanout->disconnects() << "\n";
+    }
+    if (run_readers) {
+        std::vector<int64_t> all;
+        uint64_t applied = 0, mismatch = 0, errors = 0, diverged = 0, snapshots = 0;
+        uint32_t writer_crc = crc32(w.doc.get());
+        for (auto& st : stats) {
+            applied += st.applied;
+            mismatch += st.crc_mismatch;
+            errors += st.errors;
+            snapshots += st.snapshots;
+            // with the writer in-process compare against its doc, else against the last op's crc
+            uint32_t expect = run_writer ? writer_crc : st.last_op_crc;
+            if (st.last_seq != expect_seq || st.final_crc != expect) ++diverged;
+            all.insert(all.end(), st.lat_ns.begin(), st.lat_ns.end());
+        }
+        double secs = std::chrono::duration<double>(t1 - t0).count();
+        std::cout << "[readers] applied=" << applied << " crc_mismatch=" << mismatch
+                  << " errors=" << errors << " snapshots=" << snapshots
+                  << " diverged=" << diverged << "/" << opt.readers
+                  << " expect_seq=" << expect_seq
+                  << " in " << secs << "s -> " << (secs > 0 ? applied / secs : 0) << " ops/s\n";
+        print_latency(all);
+        if (mismatch || errors || diverged) ok = false;
+    }
+    uint64_t work = run_writer ? w.sent : (stats.empty() ? 0 : stats[0].applied);
+    std::cout << std::setprecision(2) << "[cpu] " << cpu << "s total, "
+              << (work ? cpu * 1e6 / work : 0) << " us/op (whole process)\n";
+    std::cout << "[loadgen] converged=" << (ok ? "yes" : "no") << "\n";
+
+    // standalone writer: let remote readers drain and hang up before closing
+    if (opt.role == "writer") {
+        auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(opt.idle_ms + 30000);
+        while (std::chrono::steady_clock::now() < until &&
+               w.fanout->peer_count() > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+    for (auto& t : reader_links) t->stop();
+    if (w.fanout) w.fanout->stop();
+    return ok ? 0 : 1;
+}
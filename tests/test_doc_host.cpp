@@ -0,0 +1,215 @@
+// DocHost: ordering, sharding, oplog replay and damaged logs
+#include "../core/doc_host.hpp"
+#include "test_util.hpp"
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <thread>
+
+static std::string make_tmp_dir() {
+    char tmpl[] = "/tmp/syncpad-test-XXXXXX";
+    char* dir = mkdtemp(tmpl);
+    return dir ? dir : "";
+}
+
+// ---------- same document: ops apply in submit order ----------
+static void test_ordering() {
+    DocHost host(4, "");
+    host.start();
+
+    Document mirror;
+    std::mt19937 rng(7);
+    std::vector<uint64_t> seen;
+    for (int i = 0; i < 500; i++) {
+        Op op;
+        if (mirror.get().empty() || rng() % 3) {
+            op = mirror.make_insert((uint32_t)(rng() % (mirror.get().size() + 1)), std::string(1, char('a' + i % 26)));
+        } else {
+            op = mirror.make_erase((uint32_t)(rng() % mirror.get().size()), 1);
+        }
+        // positions only make sense if every earlier op landed first
+        host.submit(5, op, [&seen](uint32_t, const Op& applied) { seen.push_back(applied.seq); });
+    }
+
+    std::string content;
+    host.with_document(5, [&](Document& d) { content = d.get(); });
+    host.stop();
+
+    bool in_order = seen.size() == 500;
+    for (size_t i = 0; in_order && i < seen.size(); i++) in_order = seen[i] == i + 1;
+    check(in_order, "same-doc ops applied in submit order");
+    check(content == mirror.get(), "same-doc content matches a serial replica");
+}
+
+// ---------- different documents: different workers ----------
+static void test_sharding() {
+    DocHost host(2, "");
+    host.start();
+    check(host.shard_of(10) != host.shard_of(11), "adjacent doc ids land on different shards");
+
+    std::thread::id a, b, a2;
+    host.with_document(10, [&](Document&) { a = std::this_thread::get_id(); });
+    host.with_document(11, [&](Document&) { b = std::this_thread::get_id(); });
+    host.with_document(12, [&](Document&) { a2 = std::this_thread::get_id(); });
+    check(a != b, "docs on different shards run on different workers");
+    check(a == a2, "docs on the same shard share a worker");
+    check(a != std::this_thread::get_id(), "documents are never touched from the caller");
+
+    // called from the owning worker it must not wait on itself
+    bool inline_ran = false;
+    Document d;
+    host.submit(10, d.make_insert(0, "x"), [&](uint32_t id, const Op&) {
+        host.with_document(id, [&](Document&) { inline_ran = true; });
+    });
+    host.with_document(10, [](Document&) {});
+    check(inline_ran, "with_document from the owning worker runs inline");
+
+    // a throwing callback must not take the worker (and every doc on it) down
+    host.submit(12, d.make_insert(0, "y"), [](uint32_t, const Op&) { throw std::runtime_error("boom"); });
+    std::string after;
+    host.with_document(12, [&](Document& doc) { after = doc.get(); });
+    check(after == "y", "worker survives a throwing ApplyCallback");
+    host.stop();
+
+    bool threw = false;
+    try { host.with_document(10, [](Document&) {}); } catch (const std::exception&) { threw = true; }
+    check(threw, "with_document after stop throws");
+}
+
+// ---------- replay from the oplog dir ----------
+static void test_replay() {
+    std::string dir = make_tmp_dir();
+    Document mirror[3];
+    {
+        DocHost host(2, dir);
+        host.start();
+        for (int i = 0; i < 60; i++) {
+            uint32_t id = (uint32_t)(i % 3);
+            // '|' and newlines must survive the one-line record format
+            Op op = mirror[id].make_insert((uint32_t)mirror[id].get().size(), i % 7 ? "ab|" : "line\n");
+            host.submit(id, op);
+        }
+        Op r = mirror[1].make_replace(2, 10, "\\p|\r\n");
+        host.submit(1, r);
+        host.stop();
+    }
+
+    DocHost host(3, dir);
+    host.start();
+    for (uint32_t id = 0; id < 3; id++) {
+        std::string content;
+        uint64_t seq = 0;
+        host.with_document(id, [&](Document& d) { content = d.get(); seq = d.get_seq(); });
+        check(content == mirror[id].get() && crc32(content) == crc32(mirror[id].get()),
+              "doc " + std::to_string(id) + " replays content and CRC");
+        check(seq == mirror[id].get_seq(), "doc " + std::to_string(id) + " replays seq");
+    }
+    host.stop();
+    std::filesystem::remove_all(dir);
+}
+
+// ---------- damaged oplogs don't take the host down ----------
+static void test_damaged_log() {
+    std::string dir = make_tmp_dir();
+    Document good;
+    {
+        std::ofstream f(dir + "/doc-1.log");
+        f << Document::encode_op(good.make_insert(0, "hello"));
+        f << "garbage line\n";
+        f << "2|9|0|0|x|0\n";         // bad type
+        f << "2|1|99|0|x|0\n";        // out of bounds
+        f << Document::encode_op(good.make_insert(5, " world"));
+        f << "3|1|0|0|ab";            // torn append, no newline
+    }
+    {
+        std::ofstream f(dir + "/doc-2.log");
+        f << "1|1|0|0|ab";            // nothing but a torn record
+    }
+
+    DocHost host(2, dir);
+    host.start();
+    std::string c1, c2;
+    host.with_document(1, [&](Document& d) { c1 = d.get(); });
+    host.with_document(2, [&](Document& d) { c2 = d.get(); });
+    check(c1 == good.get(), "corrupt records skipped, good ones replayed");
+    check(c2.empty(), "torn-only log replays as empty");
+
+    // the host keeps working and the next record isn't glued onto the torn one
+    host.submit(1, good.make_insert(0, ">"));
+    host.submit(2, Document().make_insert(0, "fresh"));
+    host.stop();
+
+    check(Document::replay_from_log(dir + "/doc-1.log").get() == good.get(), "append after a torn tail replays");
+    check(Document::replay_from_log(dir + "/doc-2.log").get() == "fresh", "torn-only log accepts new records");
+    std::filesystem::remove_all(dir);
+}
+
+// ---------- the oplog must be writable before an op is acked ----------
+static void test_unwritable_log() {
+    std::string base = make_tmp_dir();
+    std::string dir = base + "/not/yet/there";
+    {
+        DocHost host(1, dir);
+        check(std::filesystem::is_directory(dir), "missing oplog dir is created");
+    }
+
+    bool threw = false;
+    std::ofstream(base + "/file") << "x";
+    try { DocHost bad(1, base + "/file/sub"); } catch (const std::runtime_error&) { threw = true; }
+    check(threw, "oplog dir that can't be created is refused");
+
+    // a directory where the log file should be: every append fails
+    std::filesystem::create_directory(dir + "/doc-3.log");
+    DocHost host(1, dir);
+    host.start();
+    Document mirror;
+    bool acked = false;
+    host.submit(4, mirror.make_insert(0, "kept"));
+    host.submit(3, Document().make_insert(0, "lost"), [&](uint32_t, const Op&) { acked = true; });
+    host.submit(3, Document().make_erase(0, 0), [&](uint32_t, const Op&) { acked = true; });
+    std::string c3, c4;
+    uint64_t seq3 = 1;
+    host.with_document(3, [&](Document& d) { c3 = d.get(); seq3 = d.get_seq(); });
+    host.with_document(4, [&](Document& d) { c4 = d.get(); });
+    host.stop();
+    check(!acked, "op that can't be logged is not acked");
+    check(c3.empty() && seq3 == 0, "op that can't be logged is rolled back");
+    check(c4 == "kept", "other documents keep logging");
+    std::filesystem::remove_all(base);
+}
+
+// ---------- out-of-range OP frames from the network ----------
+static void test_hostile_ops() {
+    auto rejects = [](const std::string& line) {
+        try { Document::decode_op(line); } catch (const std::exception&) { return true; }
+        return false;
+    };
+    check(rejects("1|2|4294967296|1||0"), "pos >= 2^32 rejected, not truncated");
+    check(rejects("1|2|0|4294967301||0"), "len >= 2^32 rejected, not truncated");
+    check(rejects("1|1|0|0|x|4294967296"), "crc >= 2^32 rejected");
+    check(rejects("99999999999999999999999|1|0|0|x|0"), "seq past 2^64 rejected");
+
+    DocHost host(1, "");
+    host.start();
+    Document mirror;
+    host.submit(1, mirror.make_insert(0, "hello world"));
+    Op evil = Document::decode_op("2|2|5|4294967295||0"); // pos + len wraps to 4
+    bool acked = false;
+    host.submit(1, evil, [&](uint32_t, const Op&) { acked = true; });
+    std::string content;
+    host.with_document(1, [&](Document& d) { content = d.get(); });
+    host.stop();
+    check(!acked && content == "hello world", "erase whose pos + len wraps is rejected");
+}
+
+int main() {
+    test_ordering();
+    test_sharding();
+    test_replay();
+    test_damaged_log();
+    test_unwritable_log();
+    test_hostile_ops();
+
+    return test_result();
+}
@@ -0,0 +1,181 @@
+// Fanout: one reader that never reads must not hold up the others
+#include "../core/fanout.hpp"
+#include "../core/document.hpp"
+#include "test_util.hpp"
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+// plain TCP reader with a tiny receive buffer that does not read until told to
+static int connect_stalled(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int small = 4096;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// read frames off the raw socket until EOF or idle; returns frame types seen
+static std::vector<uint8_t> drain_raw(int fd, Document& doc, int idle_ms) {
+    std::vector<uint8_t> types;
+    std::string in;
+    char buf[65536];
+    while (true) {
+        pollfd p{fd, POLLIN, 0};
+        if (poll(&p, 1, idle_ms) <= 0) break;
+        ssize_t r = recv(fd, buf, sizeof(buf), 0);
+        if (r <= 0) { types.push_back(0); break; } // 0 marks EOF
+        in.append(buf, (size_t)r);
+
+        size_t pos = 0;
+        while (in.size() - pos >= 4) {
+            uint32_t len_be;
+            memcpy(&len_be, in.data() + pos, 4);
+            uint32_t len = ntohl(len_be);
+            if (in.size() - pos < 4 + (size_t)len) break;
+            uint8_t type = (uint8_t)in[pos + 4];
+            std::string payload = in.substr(pos + 9, len - 5);
+            if (type == 6) doc = Document::decode_snapshot(payload);
+            if (type == 5) doc.apply(Document::decode_op(payload));
+            types.push_back(type);
+            pos += 4 + len;
+        }
+        in.erase(0, pos);
+    }
+    return types;
+}
+
+// replica fed by a normal client Transport
+struct FastReader {
+    Transport link;
+    Document doc;
+    std::thread th;
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> seq{0};
+
+    explicit FastReader(int port) : link(0, "127.0.0.1", port) {
+        link.set_local_mode(Transport::LocalMode::TCP);
+    }
+    void run() {
+        link.start();
+        th = std::thread([this] {
+            Frame f;
+            while (!stop) {
+                if (!link.wait_frame(f, 50)) continue;
+                if (f.type == 6) doc = Document::decode_snapshot(f.payload);
+                if (f.type == 5) doc.apply(Document::decode_op(f.payload));
+                seq = doc.get_seq();
+            }
+        });
+    }
+    void finish() {
+        stop = true;
+        th.join();
+        link.stop();
+    }
+};
+
+static void run_case(Fanout::LagPolicy policy, int port) {
+    bool catchup = policy == Fanout::LagPolicy::CATCH_UP;
+    std::string tag = catchup ? "[catchup] " : "[disconnect] ";
+
+    Document doc;
+    std::mutex mu; // doc is read by the catch-up hook inside broadcast
+    Fanout fan(port, 64 * 1024, policy);
+    fan.set_catchup([&]() {
+        Frame f;
+        f.type = 6;
+        f.payload = doc.encode_snapshot();
+        return std::vector<FrameBuf>{Fanout::encode(f)};
+    });
+    fan.start();
+
+    FastReader a(port), b(port);
+    a.run();
+    b.run();
+    int slow = connect_stalled(port);
+    check(slow >= 0 && wait_until([&]{ return fan.peer_count() == 3; }, 3000), tag + "three readers connected");
+
+    std::string chunk(2048, 'x');
+    auto send_op = [&]() {
+        std::lock_guard<std::mutex> lk(mu);
+        // every so often shrink the doc back to one chunk: keeps snapshots and crc cheap
+        Op op = doc.get().size() > (64 << 10)
+            ? doc.make_replace(0, (uint32_t)doc.get().size(), chunk)
+            : doc.make_insert((uint32_t)doc.get().size() / 2, chunk);
+        Frame f;
+        f.type = 5;
+        f.payload = Document::encode_op(op);
+        fan.broadcast(f);
+    };
+    auto triggered = [&]{ return catchup ? fan.catchups() >= 1 : fan.disconnects() >= 1; };
+
+    // 2 KiB ops against a 64 KiB lag limit and a reader that reads nothing
+    int sent = 0;
+    for (; sent < 4000 && !triggered(); sent++) {
+        send_op();
+        if (sent % 64 == 0) std::this_thread::yield();
+    }
+    check(triggered(), tag + "lag policy applied to the stalled reader after " + std::to_string(sent) + " ops");
+
+    uint64_t last = 0;
+    { std::lock_guard<std::mutex> lk(mu); last = doc.get_seq(); }
+    check(wait_until([&]{ return a.seq == last && b.seq == last; }, 20000),
+          tag + "fast readers received every op while the slow one stalled");
+
+    Document slow_doc;
+    std::vector<uint8_t> types;
+    if (catchup) {
+        check(fan.disconnects() == 0, tag + "slow reader kept its connection");
+        // start reading, then keep editing
+        int big = 1 << 20;
+        setsockopt(slow, SOL_SOCKET, SO_RCVBUF, &big, sizeof(big));
+        std::thread rd([&]{ types = drain_raw(slow, slow_doc, 1000); });
+        for (int i = 0; i < 200; i++) {
+            send_op();
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        rd.join();
+        size_t snaps = 0;
+        for (uint8_t t : types) snaps += t == 6;
+        // one SNAPSHOT on join, at least one more for the lag
+        check(snaps >= 2, tag + "slow reader got a SNAPSHOT after falling behind");
+        std::lock_guard<std::mutex> lk(mu);
+        check(slow_doc.get() == doc.get(), tag + "slow reader converged once it read");
+    } else {
+        types = drain_raw(slow, slow_doc, 2000);
+        check(!types.empty() && types.back() == 0, tag + "slow reader sees EOF");
+        check(wait_until([&]{ return fan.peer_count() == 2; }, 3000), tag + "slow reader removed from the peer list");
+    }
+    { std::lock_guard<std::mutex> lk(mu); last = doc.get_seq(); }
+    check(wait_until([&]{ return a.seq == last && b.seq == last; }, 20000) &&
+          a.doc.get() == b.doc.get(), tag + "fast readers converged");
+    check(wait_until([&]{ return fan.queued_bytes() == 0; }, 3000), tag + "queued_bytes back to 0");
+
+    close(slow);
+    a.finish();
+    b.finish();
+    fan.stop();
+}
+
+int main() {
+    run_case(Fanout::LagPolicy::CATCH_UP, free_port());
+    run_case(Fanout::LagPolicy::DISCONNECT, free_port());
+
+    return test_result();
+}
@@ -0,0 +1,224 @@
+// Same-host fast path: shm ring wrap, oversized frames, unix fallback, dead peers
+#include "../core/local_link.hpp"
+#include "../core/transport.hpp"
+#include "../core/fanout.hpp"
+#include "test_util.hpp"
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+static std::string pattern(size_t n, int seed) {
+    std::string s(n, '\0');
+    for (size_t i = 0; i < n; i++) s[i] = (char)((i * 31 + seed) & 0xff);
+    return s;
+}
+
+// ---------- ring positions wrap many times ----------
+static void test_wrap() {
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    int memfd = -1;
+    auto a = ShmLink::create(4096, sv[0], memfd); // smallest ring
+    auto b = a ? ShmLink::attach(memfd, sv[1]) : nullptr;
+    if (memfd >= 0) close(memfd);
+    check(a && b, "create + attach");
+    if (!a || !b) return;
+
+    // odd sizes so writes straddle the end of the ring at every offset
+    const int kMsgs = 2000;
+    std::thread wr([&] {
+        for (int i = 0; i < kMsgs; i++) {
+            std::string m = pattern(1 + (i * 397) % 3000, i);
+            if (!a->write_all(m.data(), m.size())) return;
+        }
+    });
+    bool intact = true;
+    for (int i = 0; i < kMsgs && intact; i++) {
+        std::string want = pattern(1 + (i * 397) % 3000, i);
+        std::string got(want.size(), '\0');
+        intact = b->read_all(&got[0], got.size()) && got == want;
+    }
+    wr.join();
+    check(intact, "bytes intact across ~3 MB through a 4 KiB ring");
+
+    a.reset(); // closes the link
+    char c;
+    check(!b->read_all(&c, 1), "read after close returns false");
+    close(sv[0]);
+    close(sv[1]);
+}
+
+// ---------- the memfd can't be resized under a mapped peer ----------
+static void test_sealed() {
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    int memfd = -1;
+    auto a = ShmLink::create(4096, sv[0], memfd);
+    check(a && ftruncate(memfd, 4096) < 0 && ftruncate(memfd, 1 << 30) < 0, "ring memfd is sealed against resizing");
+
+    // same size, but unsealed: attach refuses it
+    struct stat st{};
+    fstat(memfd, &st);
+    int raw = memfd_create("not-sealed", 0);
+    check(raw >= 0 && ftruncate(raw, st.st_size) == 0 && !ShmLink::attach(raw, sv[1]), "attach rejects an unsealed memfd");
+
+    close(raw);
+    close(memfd);
+    close(sv[0]);
+    close(sv[1]);
+}
+
+// ---------- a frame larger than the 1 MiB ring ----------
+static void test_big_frame() {
+    int port = free_port();
+    Transport server(port, "", 0);
+    Transport client(0, "127.0.0.1", port);
+    server.start();
+    client.start();
+    bool up = wait_until([&]{ return server.is_connected() && client.is_connected(); }, 5000);
+    check(up && client.link_kind() == "shm" && server.link_kind() == "shm", "client and server agree on shm");
+
+    Frame f;
+    f.type = 5;
+    f.doc_id = 7;
+    f.payload = pattern(3 << 20, 5);
+    check(client.send_frame(f), "send 3 MiB frame");
+    Frame g;
+    bool got = server.wait_frame(g, 5000);
+    check(got && g.payload == f.payload && g.doc_id == 7, "3 MiB frame arrives intact through the 1 MiB ring");
+
+    client.stop();
+    server.stop();
+}
+
+// ---------- server answers 'U': client stays on the unix socket ----------
+static void test_unix_fallback() {
+    {
+        int port = free_port();
+        Transport server(port, "", 0);
+        server.set_local_mode(Transport::LocalMode::UNIX);
+        Transport client(0, "127.0.0.1", port);
+        server.start();
+        client.start();
+        bool up = wait_until([&]{ return server.is_connected() && client.is_connected(); }, 5000);
+        check(up && client.link_kind() == "unix", "shm offer declined by a UNIX-mode server falls back to unix");
+
+        Frame f;
+        f.type = 5;
+        f.payload = "over unix";
+        client.send_frame(f);
+        Frame g;
+        check(server.wait_frame(g, 2000) && g.payload == "over unix", "frames flow after the fallback");
+        client.stop();
+        server.stop();
+    }
+    {
+        // the fanout never offers a ring
+        int port = free_port();
+        Fanout fan(port, 1 << 20, Fanout::LagPolicy::DISCONNECT);
+        fan.start();
+        Transport client(0, "127.0.0.1", port);
+        client.start();
+        bool up = wait_until([&]{ return client.is_connected() && fan.peer_count() == 1; }, 5000);
+        check(up && client.link_kind() == "unix", "fanout answers 'U' and the reader uses unix");
+
+        Frame f;
+        f.type = 5;
+        f.payload = "from fanout";
+        fan.broadcast(f);
+        Frame g;
+        check(client.wait_frame(g, 2000) && g.payload == "from fanout", "fanout frames reach a unix reader");
+        client.stop();
+        fan.stop();
+    }
+}
+
+// ---------- a second client must not take down the first ----------
+static void test_two_clients(Transport::LocalMode mode, int port) {
+    std::string tag = mode == Transport::LocalMode::TCP ? "[tcp] " : "[shm] ";
+    Transport server(port, "", 0);
+    Transport a(0, "127.0.0.1", port), b(0, "127.0.0.1", port);
+    server.set_local_mode(mode);
+    a.set_local_mode(mode);
+    b.set_local_mode(mode);
+    server.start();
+    a.start();
+    check(wait_until([&]{ return server.is_connected() && a.is_connected(); }, 5000), tag + "first client connected");
+
+    b.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    check(server.is_connected() && a.is_connected(), tag + "first client still connected after the second tried");
+
+    Frame f;
+    f.type = 5;
+    f.payload = "to a";
+    server.send_frame(f);
+    Frame g;
+    check(a.wait_frame(g, 2000) && g.payload == "to a", tag + "server -> first client still flows");
+    f.payload = "from a";
+    a.send_frame(f);
+    check(server.wait_frame(g, 2000) && g.payload == "from a", tag + "first client -> server still flows");
+    check(!b.pop_frame(g), tag + "second client got nothing");
+
+    b.stop();
+    a.stop();
+    server.stop();
+}
+
+// ---------- peer process dies without closing the ring ----------
+static void test_dead_peer() {
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    int memfd = -1;
+    auto a = ShmLink::create(1 << 16, sv[0], memfd);
+    check(a != nullptr, "create ring for dead-peer test");
+    if (!a) return;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(sv[0]);
+        auto b = ShmLink::attach(memfd, sv[1]);
+        if (b) b->write_all("last words", 10);
+        _exit(0); // no close(): like a crash, only the socket goes away
+    }
+    close(memfd);
+    close(sv[1]);
+
+    char buf[10];
+    check(a->read_all(buf, 10) && std::string(buf, 10) == "last words", "reads what the peer wrote before dying");
+
+    auto t0 = std::chrono::steady_clock::now();
+    bool more = a->read_all(buf, 1);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    check(!more && ms < 2000, "read from a dead peer returns false (" + std::to_string((int)ms) + " ms)");
+
+    // a full ring must notice too: fill it with no reader
+    std::string big(1 << 17, 'y');
+    t0 = std::chrono::steady_clock::now();
+    bool wrote = a->write_all(big.data(), big.size());
+    ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    check(!wrote && ms < 2000, "write into a full ring with a dead peer returns false");
+
+    waitpid(pid, nullptr, 0);
+    close(sv[0]);
+}
+
+int main() {
+    test_wrap();
+    test_sealed();
+    test_big_frame();
+    test_unix_fallback();
+    test_two_clients(Transport::LocalMode::SHM, free_port());
+    test_two_clients(Transport::LocalMode::TCP, free_port());
+    test_dead_peer();
+
+    return test_result();
+}
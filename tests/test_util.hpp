@@ -0,0 +1,57 @@
+// Shared helpers for the plain main() tests: check(), wait_until(), free_port(), test_result()
+#pragma once
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+
+inline int failures = 0;
+
+inline void check(bool ok, const std::string& what) {
+    std::cout << (ok ? "ok   " : "FAIL ") << what << "\n";
+    if (!ok) failures++;
+}
+
+// polls cond every 5 ms; false if it is still unmet after timeout_ms
+inline bool wait_until(const std::function<bool()>& cond, int timeout_ms) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!cond()) {
+        if (std::chrono::steady_clock::now() > end) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+// a TCP port nothing is listening on, so tests can run side by side; the
+// local unix socket is keyed by the port too, so it stays unique as well
+inline int free_port() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return 0;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY); // same as the servers bind
+    addr.sin_port = 0; // kernel picks
+    socklen_t len = sizeof(addr);
+    int port = 0;
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) == 0 &&
+        getsockname(fd, (sockaddr*)&addr, &len) == 0) {
+        port = ntohs(addr.sin_port);
+    }
+    close(fd);
+    return port;
+}
+
+// exit code for main(): 0 if every check passed
+inline int test_result() {
+    if (failures) {
+        std::cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+    std::cout << "Test passed!\n";
+    return 0;
+}
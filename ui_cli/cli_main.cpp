@@ -1,4 +1,5 @@
 #include "../core/transport.hpp"
+#include "../core/doc_host.hpp"
 #include <iostream>
 #include <thread>
 #include <chrono>
@@ -11,13 +12,20 @@ void print_help(const char* prog) {
     std::cout << "Usage:\n"
               << prog << " --listen <port> [--peer <host>:<port>]\n"
               << "or\n"
-              << prog << " --peer <host>:<port> [--listen <port>]\n";
+              << prog << " --peer <host>:<port> [--listen <port>]\n"
+              << "options:\n"
+              << "  --workers <n>      document worker threads (default: one per core)\n"
+              << "  --oplog-dir <dir>  keep one oplog per document in <dir>\n"
+              << "  --local <mode>     same-host link: shm|unix|tcp (default shm)\n";
 }
 
 int main(int argc, char** argv) {
     int listen_port = 0;
     std::string peer_host;
     int peer_port = 0;
+    size_t workers = 0;
+    std::string oplog_dir;
+    Transport::LocalMode local = Transport::LocalMode::SHM;
 
     // simple arg parse
     for (int i = 1; i < argc; ++i) {
@@ -32,6 +40,16 @@ int main(int argc, char** argv) {
             }
             peer_host = p.substr(0,pos);
             peer_port = std::stoi(p.substr(pos+1));
+        } else if (a == "--workers" && i+1 < argc) {
+            workers = std::stoul(argv[++i]);
+        } else if (a == "--oplog-dir" && i+1 < argc) {
+            oplog_dir = argv[++i];
+        } else if (a == "--local" && i+1 < argc) {
+            std::string m = argv[++i];
+            if (m == "shm") local = Transport::LocalMode::SHM;
+            else if (m == "unix") local = Transport::LocalMode::UNIX;
+            else if (m == "tcp") local = Transport::LocalMode::TCP;
+            else { std::cerr << "local must be shm|unix|tcp\n"; return 1; }
         } else if (a == "--help" || a == "-h") {
             print_help(argv[0]); return 0;
         }
@@ -41,7 +59,19 @@ int main(int argc, char** argv) {
         print_help(argv[0]); return 1;
     }
 
+    // every document is hosted here, sharded across the worker pool
+    std::unique_ptr<DocHost> host_ptr;
+    try {
+        host_ptr = std::make_unique<DocHost>(workers, oplog_dir);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    DocHost& host = *host_ptr;
+    host.start();
+
     Transport t(listen_port, peer_host, peer_port);
+    t.set_local_mode(local);
     t.start();
 
     std::atomic<bool> running{true};
@@ -70,7 +100,21 @@ int main(int argc, char** argv) {
             } else if (f.type == 1) {
                 std::cout << "[recv] HELLO: " << f.payload << "\n";
             } else if (f.type == 2) {
-                std::cout << "[recv] ACK: " << f.payload << "\n";
+                std::cout << "[recv] ACK doc=" << f.doc_id << ": " << f.payload << "\n";
+            } else if (f.type == 5) {
+                Op op;
+                try {
+                    op = Document::decode_op(f.payload);
+                } catch (const std::exception& e) {
+                    std::cerr << "[recv] bad OP frame for doc " << f.doc_id << ": " << e.what() << "\n";
+                    continue;
+                }
+                // applied and logged on the document's worker; ack "seq|crc" from there
+                host.submit(f.doc_id, op, [&t](uint32_t doc_id, const Op& applied) {
+                    Frame r; r.type = 2; r.doc_id = doc_id;
+                    r.payload = std::to_string(applied.seq) + "|" + std::to_string(applied.doc_crc32);
+                    t.send_frame(r);
+                });
             } else {
                 std::cout << "[recv] unknown type=" << int(f.type) << " payload=" << f.payload << "\n";
             }
@@ -82,12 +126,15 @@ int main(int argc, char** argv) {
         // print simple connected state occasionally
         static int tick = 0;
         if (++tick % 20 == 0) {
-            std::cout << "[status] connected=" << (t.is_connected() ? "yes":"no") << "\n";
+            std::cout << "[status] connected=" << (t.is_connected() ? "yes":"no");
+            if (t.is_connected()) std::cout << " link=" << t.link_kind();
+            std::cout << "\n";
         }
     }
 
     running = false;
     ping_thread.join();
     t.stop();
+    host.stop();
     return 0;
 }